@@ -0,0 +1,242 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cinttypes>
+#include <type_traits>
+#include <limits>
+#include <algorithm>
+
+// binds C++ structs to json text directly, no JSON tree is built in between.
+//
+//   struct Server { int64_t port; std::string host; std::vector<int64_t> ids; };
+//   JSON_BIND(Server, port, host, ids)      // at global scope, up to 24 fields
+//
+//   Server s;
+//   JSONBind::read(text, s);                // throws std::runtime_error
+//   std::string out = JSONBind::write(s);   // compact text
+//
+// members may be integers, std::string, std::vector<unsigned char> (raw data),
+// std::vector of any of these, or other bound structs. unknown keys are skipped
+// and missing keys leave the member untouched. like the tree parser, integers are
+// 0 to INT64_MAX, reading or writing a negative value throws. reading a value the
+// member type cannot hold throws too.
+namespace JSONBind
+{
+    // a cursor over json text, every call throws std::runtime_error with the offset on bad input
+    class Reader
+    {
+    public:
+        Reader(const std::string &_str) : str(_str) {}
+        // values above max throw, max may not exceed INT64_MAX
+        void read_int(int64_t &v, uint64_t max = INT64_MAX);
+        void read_string(std::string &v);
+        void read_raw(std::vector<unsigned char> &v);
+        void object_begin();
+        // false once the object is closed. the key is valid until the next call
+        bool next_key(const char *&key, size_t &len);
+        void array_begin();
+        // false once the array is closed
+        bool next_element();
+        void skip();
+        // the first character of the next value, 0 at the end of the text
+        char peek();
+        // consumes a null if one comes next
+        bool read_null();
+        // only blanks may follow the value
+        void finish();
+
+    private:
+        void skip_blank();
+        void expect(char ch);
+        [[noreturn]] void fail(const char *what);
+
+        const std::string &str;
+        size_t i = 0;
+        // nothing read yet in the current object or array
+        bool first = false;
+        std::string key_buf;
+    };
+
+    // appends compact json text to out
+    class Writer
+    {
+    public:
+        Writer(std::string &_out) : out(_out) {}
+        void write_int(int64_t v);
+        void write_string(const std::string &v);
+        void write_raw(const std::vector<unsigned char> &v);
+        void object_begin() { out += '{'; }
+        void key(const char *name, size_t len);
+        void object_end() { out += '}'; }
+        void array_begin() { out += '['; }
+        void element()
+        {
+            if (out.back() != '[')
+                out += ',';
+        }
+        void array_end() { out += ']'; }
+
+    private:
+        std::string &out;
+    };
+
+    // specialized by JSON_BIND
+    template <typename T>
+    struct Binding
+    {
+        static const bool bound = false;
+    };
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type read_value(Reader &r, T &v)
+    {
+        // a value the member cannot hold throws instead of being narrowed
+        uint64_t max = uint64_t(std::numeric_limits<T>::max());
+        int64_t tmp;
+        r.read_int(tmp, std::min(max, uint64_t(INT64_MAX)));
+        v = T(tmp);
+    }
+    inline void read_value(Reader &r, std::string &v)
+    {
+        r.read_string(v);
+    }
+    inline void read_value(Reader &r, std::vector<unsigned char> &v)
+    {
+        r.read_raw(v);
+    }
+    template <typename T>
+    void read_value(Reader &r, std::vector<T> &v)
+    {
+        v.clear();
+        r.array_begin();
+        while (r.next_element())
+        {
+            v.emplace_back();
+            read_value(r, v.back());
+        }
+    }
+    template <typename T>
+    typename std::enable_if<Binding<T>::bound>::type read_value(Reader &r, T &v)
+    {
+        const char *key;
+        size_t len;
+        r.object_begin();
+        while (r.next_key(key, len))
+        {
+            if (!Binding<T>::read_field(r, v, key, len))
+                r.skip();
+        }
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type write_value(Writer &w, const T &v)
+    {
+        w.write_int(int64_t(v));
+    }
+    inline void write_value(Writer &w, const std::string &v)
+    {
+        w.write_string(v);
+    }
+    inline void write_value(Writer &w, const std::vector<unsigned char> &v)
+    {
+        w.write_raw(v);
+    }
+    template <typename T>
+    void write_value(Writer &w, const std::vector<T> &v)
+    {
+        w.array_begin();
+        for (auto &item : v)
+        {
+            w.element();
+            write_value(w, item);
+        }
+        w.array_end();
+    }
+    template <typename T>
+    typename std::enable_if<Binding<T>::bound>::type write_value(Writer &w, const T &v)
+    {
+        w.object_begin();
+        Binding<T>::write_fields(w, v);
+        w.object_end();
+    }
+
+    template <typename T>
+    void read(const std::string &str, T &obj)
+    {
+        Reader r(str);
+        read_value(r, obj);
+        r.finish();
+    }
+    template <typename T>
+    std::string write(const T &obj)
+    {
+        std::string out;
+        Writer w(out);
+        write_value(w, obj);
+        return out;
+    }
+}
+
+#define JSON_BIND_EXPAND(x) x
+#define JSON_BIND_CAT_(a, b) a##b
+#define JSON_BIND_CAT(a, b) JSON_BIND_CAT_(a, b)
+#define JSON_BIND_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+                         _17, _18, _19, _20, _21, _22, _23, _24, N, ...) N
+#define JSON_BIND_COUNT(...) JSON_BIND_EXPAND(JSON_BIND_COUNT_(__VA_ARGS__, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, \
+                                                               12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+#define JSON_BIND_EACH_1(M, a) M(a)
+#define JSON_BIND_EACH_2(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_1(M, __VA_ARGS__))
+#define JSON_BIND_EACH_3(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_2(M, __VA_ARGS__))
+#define JSON_BIND_EACH_4(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_3(M, __VA_ARGS__))
+#define JSON_BIND_EACH_5(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_4(M, __VA_ARGS__))
+#define JSON_BIND_EACH_6(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_5(M, __VA_ARGS__))
+#define JSON_BIND_EACH_7(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_6(M, __VA_ARGS__))
+#define JSON_BIND_EACH_8(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_7(M, __VA_ARGS__))
+#define JSON_BIND_EACH_9(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_8(M, __VA_ARGS__))
+#define JSON_BIND_EACH_10(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_9(M, __VA_ARGS__))
+#define JSON_BIND_EACH_11(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_10(M, __VA_ARGS__))
+#define JSON_BIND_EACH_12(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_11(M, __VA_ARGS__))
+#define JSON_BIND_EACH_13(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_12(M, __VA_ARGS__))
+#define JSON_BIND_EACH_14(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_13(M, __VA_ARGS__))
+#define JSON_BIND_EACH_15(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_14(M, __VA_ARGS__))
+#define JSON_BIND_EACH_16(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_15(M, __VA_ARGS__))
+#define JSON_BIND_EACH_17(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_16(M, __VA_ARGS__))
+#define JSON_BIND_EACH_18(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_17(M, __VA_ARGS__))
+#define JSON_BIND_EACH_19(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_18(M, __VA_ARGS__))
+#define JSON_BIND_EACH_20(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_19(M, __VA_ARGS__))
+#define JSON_BIND_EACH_21(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_20(M, __VA_ARGS__))
+#define JSON_BIND_EACH_22(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_21(M, __VA_ARGS__))
+#define JSON_BIND_EACH_23(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_22(M, __VA_ARGS__))
+#define JSON_BIND_EACH_24(M, a, ...) M(a) JSON_BIND_EXPAND(JSON_BIND_EACH_23(M, __VA_ARGS__))
+#define JSON_BIND_EACH(M, ...) JSON_BIND_EXPAND(JSON_BIND_CAT(JSON_BIND_EACH_, JSON_BIND_COUNT(__VA_ARGS__))(M, __VA_ARGS__))
+
+// the key length is a compile-time constant, so most keys are rejected without touching memory
+#define JSON_BIND_READ(field)                                            \
+    if (len == sizeof(#field) - 1 && memcmp(key, #field, len) == 0)     \
+    {                                                                    \
+        read_value(r, obj.field);                                        \
+        return true;                                                     \
+    }
+#define JSON_BIND_WRITE(field)          \
+    w.key(#field, sizeof(#field) - 1); \
+    write_value(w, obj.field);
+
+#define JSON_BIND(Type, ...)                                                      \
+    namespace JSONBind                                                            \
+    {                                                                             \
+        template <>                                                               \
+        struct Binding<Type>                                                      \
+        {                                                                         \
+            static const bool bound = true;                                       \
+            static bool read_field(Reader &r, Type &obj, const char *key, size_t len) \
+            {                                                                     \
+                JSON_BIND_EACH(JSON_BIND_READ, __VA_ARGS__)                       \
+                return false;                                                     \
+            }                                                                     \
+            static void write_fields(Writer &w, const Type &obj)                  \
+            {                                                                     \
+                JSON_BIND_EACH(JSON_BIND_WRITE, __VA_ARGS__)                      \
+            }                                                                     \
+        };                                                                        \
+    }
@@ -5,9 +5,97 @@
 #include <map>
 #include <fstream>
 #include <cstring>
+#include <memory>
+#include <thread>
 #include "json_parser.hpp"
-#include <codecvt>
-#include <locale>
+#include "json_bind.hpp"
+#ifdef JSON_LITE_STATS
+#include <chrono>
+#endif
+#ifdef JSON_LITE_ZLIB
+#include <zlib.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// instrumentation, every JSON_STATS* macro compiles to nothing without JSON_LITE_STATS
+#ifdef JSON_LITE_STATS
+namespace
+{
+    thread_local JSON::Stats *cur_stats = nullptr;
+    thread_local JSON::Stats last_stats_slot;
+
+    JSON::StatsHook &stats_hook()
+    {
+        static JSON::StatsHook hook;
+        return hook;
+    }
+    uint64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    // collects the counters of one event, nested events get their own scope
+    class StatsScope
+    {
+    public:
+        StatsScope(const char *_event, size_t bytes) : event(_event), prev(cur_stats), stamp(now_ns())
+        {
+            stats.bytes = bytes;
+            cur_stats = &stats;
+        }
+        void lap(JSON::Stats::Phase phase)
+        {
+            uint64_t t = now_ns();
+            stats.phase_ns[phase] += t - stamp;
+            stamp = t;
+        }
+        void finish()
+        {
+            // restore first, so the hook itself may parse
+            cur_stats = prev;
+            last_stats_slot = stats;
+            if (stats_hook())
+                stats_hook()(event, stats);
+        }
+        ~StatsScope()
+        {
+            cur_stats = prev;
+        }
+
+    private:
+        JSON::Stats stats;
+        const char *event;
+        JSON::Stats *prev;
+        uint64_t stamp;
+    };
+}
+#define JSON_STATS(...)      \
+    do                       \
+    {                        \
+        if (cur_stats)       \
+        {                    \
+            __VA_ARGS__;     \
+        }                    \
+    } while (0)
+#define JSON_STATS_DECL(...) __VA_ARGS__
+#define JSON_STATS_BEGIN(event, bytes) StatsScope stats_scope(event, bytes)
+#define JSON_STATS_LAP(phase) stats_scope.lap(JSON::Stats::phase)
+#define JSON_STATS_END() stats_scope.finish()
+#else
+#define JSON_STATS(...) \
+    do                  \
+    {                   \
+    } while (0)
+#define JSON_STATS_DECL(...)
+#define JSON_STATS_BEGIN(event, bytes)
+#define JSON_STATS_LAP(phase)
+#define JSON_STATS_END()
+#endif
 
 // some utils functions
 namespace
@@ -48,33 +136,76 @@ namespace
         }
         return ret;
     }
-    // utf-8 char size
-    int get_char_size(unsigned char ch)
+    // appends the decimal form of v without a temporary string
+    void append_int(std::string &out, int64_t v)
     {
-        unsigned char header = ch >> 4;
-        int len = 0;
-        if ((header >> 3 & 1) == 0)
-            return 1;
-        for (int k = 3; k >= 1; k--)
+        char buf[24];
+        char *p = buf + sizeof(buf);
+        uint64_t u = v < 0 ? 0 - uint64_t(v) : uint64_t(v);
+        do
+        {
+            *--p = char('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0)
+            *--p = '-';
+        out.append(p, buf + sizeof(buf) - p);
+    }
+    // the splitmix64 finalizer, spreads every input bit over the whole word
+    uint64_t mix64(uint64_t h)
+    {
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+    // 8 bytes per step, not meant to resist crafted collisions
+    uint64_t hash_bytes(const void *data, size_t len, uint64_t seed)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        uint64_t h = mix64(seed ^ len);
+        for (; len >= 8; p += 8, len -= 8)
         {
-            if (header >> k & 1)
-                len++;
+            uint64_t w;
+            memcpy(&w, p, 8);
+            h = mix64(h ^ w);
         }
-        return len;
+        uint64_t tail = 0;
+        if (len)
+            memcpy(&tail, p, len);
+        return mix64(h ^ tail ^ (uint64_t(len) << 56));
+    }
+    uint64_t hash_combine(uint64_t h, uint64_t v)
+    {
+        return mix64(h + 0x9e3779b97f4a7c15ULL + v);
     }
-    // to parse a number from str+i
+    // utf-8 char size
+    int get_char_size(unsigned char ch)
+    {
+        if ((ch & 0xE0) == 0xC0)
+            return 2;
+        if ((ch & 0xF0) == 0xE0)
+            return 3;
+        if ((ch & 0xF8) == 0xF0)
+            return 4;
+        // ASCII or a stray continuation byte
+        return 1;
+    }
+    // to parse a number from str+i, throws past INT64_MAX like the validator
     long long get_number(const std::string &str, int &i)
     {
-        long long v = str[i] - '0';
+        uint64_t v = str[i] - '0';
         i++;
         while (i < str.size() && isdigit(str[i]))
         {
-            v *= 10;
-            v += str[i] - '0';
+            v = v * 10 + (str[i] - '0');
+            if (v > uint64_t(INT64_MAX))
+                throw std::runtime_error("build_token_stream: integer out of range");
             i++;
         }
         i--;
-        return v;
+        return (long long)v;
     }
     // to parse a word or number
     std::string get_word(const std::string &str, int &i)
@@ -87,6 +218,256 @@ namespace
         return str.substr(sp, len);
     }
 }
+// base64 for raw data crossing to standard json. the block kernels follow Wojciech Mula's
+// SSSE3 and AVX2 algorithms and are picked at compile time, build with -mssse3, -mavx2 or
+// -march=native to get them
+namespace
+{
+    const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    // marks a string holding raw data
+    const char BASE64_PREFIX[] = "data:application/octet-stream;base64,";
+    const size_t BASE64_PREFIX_LEN = sizeof(BASE64_PREFIX) - 1;
+
+    // the 6 bit value of every char, -1 outside the alphabet
+    struct Base64Values
+    {
+        signed char of[256];
+        Base64Values()
+        {
+            memset(of, -1, sizeof(of));
+            for (int k = 0; k < 64; k++)
+                of[(unsigned char)BASE64_CHARS[k]] = (signed char)k;
+        }
+    };
+    const signed char *base64_values()
+    {
+        static const Base64Values table;
+        return table.of;
+    }
+
+#if defined(__SSSE3__)
+    // 12 bytes at the start of in to 16 chars
+    inline __m128i base64_encode_block(__m128i in)
+    {
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(hi, lo);
+        // 0 for a-z, 1-10 for 0-9, 11 and 12 for + and /, 13 for A-Z
+        __m128i range = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+        __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        return _mm_add_epi8(idx, _mm_shuffle_epi8(shift, range));
+    }
+    // 16 chars to 12 bytes at the start of the result, false if a char is outside the alphabet
+    inline bool base64_decode_block(__m128i &in)
+    {
+        const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                             0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                             0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask = _mm_set1_epi8(0x2f);
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, mask));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff)
+            return false;
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(in, mask), hi_nibbles));
+        in = _mm_add_epi8(in, roll);
+        in = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+        in = _mm_madd_epi16(in, _mm_set1_epi32(0x00011000));
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        return true;
+    }
+#endif
+#if defined(__AVX2__)
+    // the SSSE3 kernels on both lanes, each lane works on its own 12 bytes or 16 chars
+    inline __m256i base64_encode_block(__m256i in)
+    {
+        in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(hi, lo);
+        __m256i range = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+        __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                         'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        return _mm256_add_epi8(idx, _mm256_shuffle_epi8(shift, range));
+    }
+    // 32 chars to 24 bytes at the start of the result
+    inline bool base64_decode_block(__m256i &in)
+    {
+        const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                                0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                                0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                  0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i mask = _mm256_set1_epi8(0x2f);
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, mask));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            return false;
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, mask), hi_nibbles));
+        in = _mm256_add_epi8(in, roll);
+        in = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+        in = _mm256_madd_epi16(in, _mm256_set1_epi32(0x00011000));
+        in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        return true;
+    }
+#endif
+
+    size_t base64_encoded_size(size_t n)
+    {
+        return (n + 2) / 3 * 4;
+    }
+    // writes base64_encoded_size(n) chars to dst
+    void base64_encode(const unsigned char *src, size_t n, char *dst)
+    {
+#if defined(__AVX2__)
+        // the second load reads 16 bytes from src + 12
+        for (; n >= 28; src += 24, n -= 24, dst += 32)
+        {
+            __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)src)),
+                                                 _mm_loadu_si128((const __m128i *)(src + 12)), 1);
+            _mm256_storeu_si256((__m256i *)dst, base64_encode_block(in));
+        }
+#endif
+#if defined(__SSSE3__)
+        for (; n >= 16; src += 12, n -= 12, dst += 16)
+            _mm_storeu_si128((__m128i *)dst, base64_encode_block(_mm_loadu_si128((const __m128i *)src)));
+#endif
+        for (; n >= 3; src += 3, n -= 3, dst += 4)
+        {
+            uint32_t w = uint32_t(src[0]) << 16 | uint32_t(src[1]) << 8 | src[2];
+            dst[0] = BASE64_CHARS[w >> 18];
+            dst[1] = BASE64_CHARS[w >> 12 & 63];
+            dst[2] = BASE64_CHARS[w >> 6 & 63];
+            dst[3] = BASE64_CHARS[w & 63];
+        }
+        if (n)
+        {
+            uint32_t w = uint32_t(src[0]) << 16 | (n == 2 ? uint32_t(src[1]) << 8 : 0);
+            dst[0] = BASE64_CHARS[w >> 18];
+            dst[1] = BASE64_CHARS[w >> 12 & 63];
+            dst[2] = n == 2 ? BASE64_CHARS[w >> 6 & 63] : '=';
+            dst[3] = '=';
+        }
+    }
+    // the = at the end of a padded text
+    size_t base64_padding(const char *src, size_t n)
+    {
+        if (n < 4 || src[n - 1] != '=')
+            return 0;
+        return src[n - 2] == '=' ? 2 : 1;
+    }
+    // n must be a multiple of 4
+    size_t base64_decoded_size(const char *src, size_t n)
+    {
+        return (n - base64_padding(src, n)) * 3 / 4;
+    }
+    // the length must be a multiple of 4 and = may only pad the end.
+    // bad is the offset of the first wrong char, n if the length is wrong
+    bool base64_check(const char *src, size_t n, size_t &bad)
+    {
+        if (n % 4)
+        {
+            bad = n;
+            return false;
+        }
+        size_t body = n - base64_padding(src, n);
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 32 <= body; i += 32)
+        {
+            __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+            if (!base64_decode_block(in))
+                break;
+        }
+#endif
+#if defined(__SSSE3__)
+        for (; i + 16 <= body; i += 16)
+        {
+            __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+            if (!base64_decode_block(in))
+                break;
+        }
+#endif
+        const signed char *values = base64_values();
+        for (; i < body; i++)
+        {
+            if (values[(unsigned char)src[i]] < 0)
+            {
+                bad = i;
+                return false;
+            }
+        }
+        return true;
+    }
+    // writes base64_decoded_size(src, n) bytes to dst, false if src is not valid base64
+    bool base64_decode(const char *src, size_t n, unsigned char *dst)
+    {
+        if (n % 4)
+            return false;
+        const char *end = src + n - base64_padding(src, n);
+        // a block stores more than it decodes, the chars left behind it decode to the slack
+#if defined(__AVX2__)
+        for (; end - src >= 48; src += 32, dst += 24)
+        {
+            __m256i in = _mm256_loadu_si256((const __m256i *)src);
+            if (!base64_decode_block(in))
+                break;
+            _mm256_storeu_si256((__m256i *)dst, in);
+        }
+#endif
+#if defined(__SSSE3__)
+        for (; end - src >= 24; src += 16, dst += 12)
+        {
+            __m128i in = _mm_loadu_si128((const __m128i *)src);
+            if (!base64_decode_block(in))
+                break;
+            _mm_storeu_si128((__m128i *)dst, in);
+        }
+#endif
+        const signed char *values = base64_values();
+        for (; end - src >= 4; src += 4, dst += 3)
+        {
+            int a = values[(unsigned char)src[0]], b = values[(unsigned char)src[1]];
+            int c = values[(unsigned char)src[2]], d = values[(unsigned char)src[3]];
+            if ((a | b | c | d) < 0)
+                return false;
+            uint32_t w = uint32_t(a) << 18 | uint32_t(b) << 12 | uint32_t(c) << 6 | uint32_t(d);
+            dst[0] = (unsigned char)(w >> 16);
+            dst[1] = (unsigned char)(w >> 8);
+            dst[2] = (unsigned char)w;
+        }
+        // 2 or 3 chars before the padding
+        if (end - src >= 2)
+        {
+            int a = values[(unsigned char)src[0]], b = values[(unsigned char)src[1]];
+            int c = end - src == 3 ? values[(unsigned char)src[2]] : 0;
+            if ((a | b | c) < 0)
+                return false;
+            uint32_t w = uint32_t(a) << 18 | uint32_t(b) << 12 | uint32_t(c) << 6;
+            dst[0] = (unsigned char)(w >> 16);
+            if (end - src == 3)
+                dst[1] = (unsigned char)(w >> 8);
+        }
+        return true;
+    }
+}
 // Lexer to scan the string and split them to tokens
 namespace Lexer
 {
@@ -97,6 +478,7 @@ namespace Lexer
         INTEGER,
         STRING,
         RAW_DATA,
+        INT_ARRAY,
         LSB,
         RSB,
         LPAR,
@@ -159,7 +541,7 @@ namespace Lexer
     {
     public:
         StringToken(const std::string &str) : Token(STRING), value(str) {}
-        static std::string get_content(Token *tok)
+        static std::string &get_content(Token *tok)
         {
             return static_cast<StringToken *>(tok)->value;
         }
@@ -175,7 +557,12 @@ namespace Lexer
     class Integer final : public Token
     {
     public:
-        Integer(int64_t v) : Token(INTEGER), value(v) {}
+        Integer(int64_t v, bool _null = false) : Token(INTEGER), null(_null), value(v) {}
+        void assign(int64_t v, bool _null)
+        {
+            value = v;
+            null = _null;
+        }
         std::string to_string() const override
         {
             return "<integer:" + std::to_string(value) + ">";
@@ -184,8 +571,14 @@ namespace Lexer
         {
             return static_cast<Integer *>(tok)->value;
         }
+        // written as null, the value is 0
+        static bool is_null(Token *tok)
+        {
+            return static_cast<Integer *>(tok)->null;
+        }
 
     private:
+        bool null;
         int64_t value;
     };
 
@@ -204,7 +597,7 @@ namespace Lexer
     public:
         RawData(const std::vector<unsigned char> &dat) : Token(RAW_DATA), data(dat) {}
         RawData(std::vector<unsigned char> &&dat) : Token(RAW_DATA), data(std::move(dat)) {}
-        static std::vector<unsigned char> get_raw_data(Token *tok)
+        static std::vector<unsigned char> &get_raw_data(Token *tok)
         {
             return static_cast<RawData *>(tok)->data;
         }
@@ -217,17 +610,162 @@ namespace Lexer
         std::vector<unsigned char> data;
     };
 
+    // an array holding nothing but integers, read in one go
+    class IntArray : public Token
+    {
+    public:
+        IntArray(std::vector<int64_t> &&vals) : Token(INT_ARRAY), values(std::move(vals)) {}
+        static std::vector<int64_t> &get_values(Token *tok)
+        {
+            return static_cast<IntArray *>(tok)->values;
+        }
+        std::string to_string() const override
+        {
+            return "<int array:" + std::to_string(values.size()) + " items>";
+        }
+
+    private:
+        std::vector<int64_t> values;
+    };
+
+#ifdef JSON_LITE_STATS
+    void count_token(Tag tag)
+    {
+        switch (tag)
+        {
+        case STRING:
+            cur_stats->tokens[JSON::STRING]++;
+            cur_stats->bytes_allocated += sizeof(StringToken);
+            break;
+        case INTEGER:
+            cur_stats->tokens[JSON::INT]++;
+            cur_stats->bytes_allocated += sizeof(Integer);
+            break;
+        case RAW_DATA:
+            cur_stats->tokens[JSON::RAW]++;
+            cur_stats->bytes_allocated += sizeof(RawData);
+            break;
+        case INT_ARRAY:
+            cur_stats->tokens[JSON::ARRAY]++;
+            cur_stats->bytes_allocated += sizeof(IntArray);
+            break;
+        case LSB:
+            cur_stats->tokens[JSON::ARRAY]++;
+            cur_stats->bytes_allocated += sizeof(Token);
+            break;
+        case BEGIN:
+            cur_stats->tokens[JSON::GROUP]++;
+            cur_stats->bytes_allocated += sizeof(Token);
+            break;
+        default:
+            cur_stats->other_tokens++;
+            cur_stats->bytes_allocated += sizeof(Token);
+            break;
+        }
+        cur_stats->bytes_allocated += sizeof(Token *);
+    }
+#endif
+
+    // tokens a JSON::Context keeps between parses, each keeps its string or vector capacity
+    class TokenPool
+    {
+    public:
+        TokenPool() = default;
+        TokenPool(const TokenPool &) = delete;
+        ~TokenPool()
+        {
+            for (auto &list : free)
+                for (auto tok : list)
+                    delete tok;
+        }
+        Token *take(Tag tag)
+        {
+            if (free[tag].empty())
+                return nullptr;
+            Token *tok = free[tag].back();
+            free[tag].pop_back();
+            return tok;
+        }
+        void give(Token *tok)
+        {
+            free[tok->get_tag()].push_back(tok);
+        }
+
+    private:
+        std::vector<Token *> free[END_TAG + 1];
+    };
+
     class TokenStream
     {
     public:
         TokenStream() = default;
+        // tokens come from and go back to pool
+        TokenStream(TokenPool *_pool) : pool(_pool) {}
 
         ~TokenStream()
+        {
+            clear();
+        }
+        // drops the tokens, the stream can be built again
+        void clear()
         {
             for (auto a : tokens)
-                delete a;
+                drop(a);
+            tokens.clear();
+            cur_p = 0;
+            JSON_STATS(depth = 0);
+        }
+        void push(Token *tok)
+        {
+            JSON_STATS(count_token(tok->get_tag()));
+            tokens.push_back(tok);
+        }
+        // the make functions recycle tokens when the stream has a pool
+        Token *make_token(Tag tag)
+        {
+            if (Token *tok = recycled(tag))
+                return tok;
+            return tag == END_LINE ? new EndLine() : new Token(tag);
+        }
+        Integer *make_integer(int64_t v, bool null = false)
+        {
+            if (Token *tok = recycled(INTEGER))
+            {
+                static_cast<Integer *>(tok)->assign(v, null);
+                return static_cast<Integer *>(tok);
+            }
+            return new Integer(v, null);
+        }
+        // the content is empty, fill it through get_content
+        StringToken *make_string()
+        {
+            if (Token *tok = recycled(STRING))
+            {
+                StringToken::get_content(tok).clear();
+                return static_cast<StringToken *>(tok);
+            }
+            return new StringToken(std::string());
+        }
+        RawData *make_raw()
+        {
+            if (Token *tok = recycled(RAW_DATA))
+                return static_cast<RawData *>(tok);
+            return new RawData(std::vector<unsigned char>());
+        }
+        IntArray *make_int_array()
+        {
+            if (Token *tok = recycled(INT_ARRAY))
+                return static_cast<IntArray *>(tok);
+            return new IntArray(std::vector<int64_t>());
+        }
+        // frees or recycles a token that was made but not pushed
+        void drop(Token *tok)
+        {
+            if (pool)
+                pool->give(tok);
+            else
+                delete tok;
         }
-        void push(Token *tok) { tokens.push_back(tok); }
         Token *current()
         {
 
@@ -267,14 +805,21 @@ namespace Lexer
         {
             return tokens.size();
         }
+        // open brackets so far, a stream may be built from several chunks
+        JSON_STATS_DECL(size_t depth = 0);
 
     private:
+        Token *recycled(Tag tag)
+        {
+            return pool ? pool->take(tag) : nullptr;
+        }
         std::vector<Token *> tokens;
         int cur_p = 0;
+        TokenPool *pool = nullptr;
     };
 
     // cpp json lite supports insert raw binary data to the json
-    RawData *get_raw_data(const std::string &str, int &i)
+    void get_raw_data(const std::string &str, int &i, std::vector<unsigned char> &out)
     {
         // skip (
         i++;
@@ -294,437 +839,3357 @@ namespace Lexer
         if (i + sz >= str.size())
             throw std::runtime_error("invalid raw_data format may be loss right $? ");
         // raw_data;
-        std::string tmp_str = str.substr(i, sz);
-
-        std::vector<unsigned char> vec(tmp_str.begin(), tmp_str.end());
+        out.assign(str.begin() + i, str.begin() + i + sz);
+        JSON_STATS(cur_stats->bytes_allocated += sz);
         // skip raw_data
         i += sz;
         if (i >= str.size() || str[i] != '$')
             throw std::runtime_error("invalid raw_data format may be loss right $!");
-        return new RawData(std::move(vec));
     }
 
-    TokenStream *build_token_stream(const std::string &str)
+    // decodes the string literal starting at the " in str[i] into v, i is left on the closing ".
+    // returns true if the literal had escapes
+    bool get_string(const std::string &str, int &i, std::string &v)
     {
-        TokenStream *token_stream = new TokenStream();
-        for (int i = 0; i < str.size(); i++)
+        bool escaped = false;
+        i++;
+        while (i < str.size() && str[i] != '\"')
         {
-            char ch = str[i];
-            if (isdigit(ch))
-            {
-                token_stream->push(new Integer(get_number(str, i)));
-                continue;
-            }
-            else if (ch == '(')
+            // runs of plain ASCII are copied at once
+            size_t run = i;
+            while (run < str.size() && str[run] != '\"' && str[run] != '\\' && (unsigned char)str[run] < 0x80)
+                run++;
+            if (run > size_t(i))
             {
-                token_stream->push(get_raw_data(str, i));
+                v.append(str, i, run - i);
+                i = int(run);
                 continue;
             }
-            if (ch == '\"')
+            // process UTF8;
+            int len = get_char_size(str[i]);
+            if (len == 1)
             {
-                std::string v;
-                i++;
-                while (i < str.size() && str[i] != '\"')
+                if (str[i] == '\\')
                 {
-                    // process UTF8;
-                    int len = get_char_size(str[i]);
-                    if (len == 1)
+                    escaped = true;
+                    if (i + 1 >= str.size())
+                        throw std::runtime_error("build_token_stream: invalid string");
+                    i++;
+                    switch (str[i])
                     {
-                        if (str[i] == '\\')
+                    case 'u':
+                    {
+                        // to support unicode encoding
+                        if (i + 4 >= str.size())
+                            throw std::runtime_error("build_token_stream: invalid string illegae unicode escape");
+                        uint16_t encoding = 0;
+                        for (int k = 1; k <= 4; k++)
                         {
-                            if (i + 1 >= str.size())
-                                throw std::runtime_error("build_token_stream: invalid string");
-                            i++;
-                            switch (str[i])
-                            {
-                            case 'u':
-                            {
-                                // to support unicode encoding
-                                if (i + 4 >= str.size())
-                                    throw std::runtime_error("build_token_stream: invalid string illegae unicode escape");
-                                uint16_t encoding = 0;
-                                for (int k = 1; k <= 4; k++)
-                                {
-                                    uint8_t c = 0;
-                                    if (isdigit(str[i + k]))
-                                        c = str[i + k] - '0';
-                                    else
-                                        c = toupper(str[i + k]) - 'A' + 10;
-                                    encoding = (encoding << 4) + c;
-                                }
-                                // convert unicode to UTF8
-                                std::wstring wstr;
-                                wstr.push_back(encoding);
-                                std::wstring_convert<std::codecvt_utf8<wchar_t>> wcv;
-                                auto utf_bytes = wcv.to_bytes(wstr);
-                                v.append(wcv.to_bytes(wstr));
-                                i += 4;
-                                break;
-                            }
-                            case 'r':
-                                v += '\r';
-                                break;
-                            case 'n':
-                                v += '\n';
-                                break;
-                            case 't':
-                                v += '\t';
-                                break;
-                            case 'b':
-                                v += '\b';
-                                break;
-                            case 'f':
-                                v += '\f';
-                                break;
-                            case '\\':
-                            case '\"':
-                            case '\'':
-                                v += str[i];
-                                break;
-                            default:
-                                throw std::runtime_error("build_token_stream: invalid string, unknown escape char ASCII(dec)" + std::to_string(unsigned(str[i])));
-                            }
+                            uint8_t c = 0;
+                            if (isdigit(str[i + k]))
+                                c = str[i + k] - '0';
+                            else
+                                c = toupper(str[i + k]) - 'A' + 10;
+                            encoding = (encoding << 4) + c;
+                        }
+                        // convert unicode to UTF8
+                        if (encoding < 0x80)
+                            v += char(encoding);
+                        else if (encoding < 0x800)
+                        {
+                            v += char(0xC0 | encoding >> 6);
+                            v += char(0x80 | (encoding & 0x3F));
                         }
                         else
-                            v += str[i];
-                        i++;
-                    }
-                    else
-                    {
-                        for (int k = 0; k < len; k++, i++)
                         {
-                            v += str[i];
-
-                            if (i >= str.size())
-                            {
-                                throw std::runtime_error("Lexer Error: invalid UTF8 string\n");
-                            }
+                            v += char(0xE0 | encoding >> 12);
+                            v += char(0x80 | (encoding >> 6 & 0x3F));
+                            v += char(0x80 | (encoding & 0x3F));
                         }
+                        i += 4;
+                        break;
+                    }
+                    case 'r':
+                        v += '\r';
+                        break;
+                    case 'n':
+                        v += '\n';
+                        break;
+                    case 't':
+                        v += '\t';
+                        break;
+                    case 'b':
+                        v += '\b';
+                        break;
+                    case 'f':
+                        v += '\f';
+                        break;
+                    case '\\':
+                    case '\"':
+                    case '\'':
+                        v += str[i];
+                        break;
+                    default:
+                        throw std::runtime_error("build_token_stream: invalid string, unknown escape char ASCII(dec)" + std::to_string(unsigned(str[i])));
                     }
                 }
-                token_stream->push(new StringToken(v));
-                continue;
+                else
+                    v += str[i];
+                i++;
             }
-
-            switch (ch)
+            else
             {
-            case '[':
-            case ']':
-            case '{':
-            case '}':
-            case ':':
-            case ',':
-                token_stream->push(new Token(string_to_tag()[std::string(1, ch)]));
-                break;
-            case '\r':
-            case '\n':
-                token_stream->push(new EndLine());
-                break;
-            default:
-                if (isalpha(ch))
+                for (int k = 0; k < len; k++, i++)
                 {
-                    std::string word = get_word(str, i);
-                    if (word == "null" || word == "false")
-                    {
-                        token_stream->push(new Integer(0));
-                    }
-                    else if (word == "true")
-                    {
-                        token_stream->push(new Integer(1));
-                    }
-                    else
+                    v += str[i];
+
+                    if (i >= str.size())
                     {
-                        throw std::runtime_error("unexcepted word: " + word);
+                        throw std::runtime_error("Lexer Error: invalid UTF8 string\n");
                     }
                 }
-                break;
             }
         }
-        token_stream->push(new Token(END_TAG));
-        return token_stream;
+        return escaped;
     }
 
-}
-namespace Parser
-{
-    // Header
-    // statement
-    enum NodeType
-    {
-        STRING = 1,
-        INT = 2,
-        ARRAY = 3,
-        GROUP = 4,
-        RAW = 5
-    };
-    class Node
+    // the position after the string literal starting at str[i]
+    size_t skip_string(const std::string &str, size_t i)
     {
-    public:
-        Node(NodeType nt) : type(nt) {}
-        int64_t &get_int();
-        std::string &get_str();
-        std::vector<unsigned char> &get_raw();
-        Node *at(const std::string &str)
+        const char *base = str.data();
+        size_t n = str.size();
+        i++;
+        while (true)
         {
-            return operator[](str);
+            const char *q = static_cast<const char *>(memchr(base + i, '\"', n - i));
+            if (!q)
+                throw std::runtime_error("skip_value: unterminated string");
+            size_t pos = q - base;
+            // an odd run of backslashes escapes the quote
+            size_t slashes = 0;
+            while (pos - slashes > i && base[pos - slashes - 1] == '\\')
+                slashes++;
+            i = pos + 1;
+            if (slashes % 2 == 0)
+                return i;
         }
-        Node *at(size_t idx)
+    }
+    // the position after (length)$raw_content$ starting at str[i]
+    size_t skip_raw(const std::string &str, size_t i)
+    {
+        size_t sz = 0;
+        i++;
+        while (i < str.size() && isdigit(str[i]) && sz <= str.size())
+            sz = sz * 10 + (str[i++] - '0');
+        if (sz > str.size() || i + 1 >= str.size() || str[i] != ')' || str[i + 1] != '$' || i + 2 + sz >= str.size() || str[i + 2 + sz] != '$')
+            throw std::runtime_error("invalid raw_data format! use (length)$raw_content$ to define a raw data");
+        return i + 3 + sz;
+    }
+    // the position after the value starting at str[i]. only strings, raw data and
+    // bracket nesting are looked at, so skipped content is not fully validated
+    size_t skip_value(const std::string &str, size_t i)
+    {
+        size_t depth = 0;
+        size_t n = str.size();
+        while (i < n)
         {
-            return operator[](idx);
+            char ch = str[i];
+            if (ch == '\"')
+                i = skip_string(str, i);
+            else if (ch == '(')
+                i = skip_raw(str, i);
+            else if (ch == '[' || ch == '{')
+            {
+                depth++;
+                i++;
+                continue;
+            }
+            else if (ch == ']' || ch == '}')
+            {
+                if (depth == 0)
+                    throw std::runtime_error("skip_value: unexpected " + std::string(1, ch));
+                depth--;
+                i++;
+            }
+            else if (depth == 0 && isalnum(ch))
+            {
+                while (i < n && isalnum(str[i]))
+                    i++;
+            }
+            else
+            {
+                i++;
+                continue;
+            }
+            if (depth == 0)
+                return i;
         }
-        Node *operator[](const std::string &str);
-        Node *operator[](size_t idx);
-
-        NodeType get_type() const { return type; }
-        virtual ~Node();
+        throw std::runtime_error("skip_value: unexpected end of input");
+    }
 
-    private:
-        NodeType type;
+    // fast path for [1, 2, 3], the digits are accumulated straight into a packed buffer.
+    // returns false without moving i if the array holds anything but integers,
+    // truncated tells whether it ran into the end of str
+    bool get_int_array(const std::string &str, int &i, std::vector<int64_t> &out, bool &truncated)
+    {
+        const char *p = str.data() + i + 1;
+        const char *end = str.data() + str.size();
+        out.clear();
+        truncated = true;
+        while (true)
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+                p++;
+            if (p >= end)
+                return false;
+            if (!isdigit(*p))
+                break;
+            uint64_t v = 0;
+            while (p < end && unsigned(*p - '0') < 10)
+            {
+                v = v * 10 + unsigned(*p++ - '0');
+                if (v > uint64_t(INT64_MAX))
+                    throw std::runtime_error("build_token_stream: integer out of range");
+            }
+            out.push_back(int64_t(v));
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+                p++;
+            if (p >= end)
+                return false;
+            if (*p == ']')
+            {
+                i = int(p - str.data());
+                return true;
+            }
+            if (*p != ',')
+                break;
+            p++;
+        }
+        truncated = false;
+        return false;
+    }
+
+    // false if the token starting at str[i] may go on past the end of str.
+    // malformed tokens count as complete, the lexer reports them
+    bool token_complete(const std::string &str, size_t i)
+    {
+        size_t n = str.size();
+        char ch = str[i];
+        if (isdigit(ch) || isalpha(ch))
+        {
+            bool digit = isdigit(ch);
+            while (i < n && (digit ? isdigit(str[i]) : isalpha(str[i])))
+                i++;
+            return i < n;
+        }
+        if (ch == '\"')
+        {
+            while (true)
+            {
+                const char *q = static_cast<const char *>(memchr(str.data() + i + 1, '\"', n - i - 1));
+                if (!q)
+                    return false;
+                size_t pos = q - str.data();
+                size_t slashes = 0;
+                // an odd run of backslashes escapes the quote
+                while (pos - slashes > i && str[pos - slashes - 1] == '\\')
+                    slashes++;
+                if (slashes % 2 == 0)
+                    return true;
+                i = pos;
+            }
+        }
+        if (ch == '(')
+        {
+            size_t sz = 0;
+            i++;
+            while (i < n && isdigit(str[i]) && sz <= n)
+                sz = sz * 10 + (str[i++] - '0');
+            if (i < n && str[i] != ')')
+                return true;
+            return sz <= n && i + 2 + sz < n;
+        }
+        return true;
+    }
+
+    // appends the tokens of str to token_stream, which keeps them on a throw.
+    // a partial str is a chunk of a longer text, lexing stops before a token that may go on
+    // in the next chunk and the position reached is returned. otherwise the end tag is added
+    size_t build_token_stream(const std::string &str, TokenStream &token_stream, bool partial = false)
+    {
+        // made ahead for the int array fast path, kept until an array fits it
+        IntArray *ints = nullptr;
+        JSON_STATS_DECL(size_t &depth = token_stream.depth);
+        int i = 0;
+        try
+        {
+            for (; i < str.size(); i++)
+            {
+                char ch = str[i];
+                if (partial && !token_complete(str, i))
+                    break;
+                if (isdigit(ch))
+                {
+                    token_stream.push(token_stream.make_integer(get_number(str, i)));
+                    continue;
+                }
+                else if (ch == '(')
+                {
+                    RawData *tok = token_stream.make_raw();
+                    token_stream.push(tok);
+                    get_raw_data(str, i, RawData::get_raw_data(tok));
+                    continue;
+                }
+                if (ch == '\"')
+                {
+                    StringToken *tok = token_stream.make_string();
+                    token_stream.push(tok);
+                    std::string &v = StringToken::get_content(tok);
+                    JSON_STATS_DECL(bool escaped =) get_string(str, i, v);
+                    JSON_STATS(cur_stats->bytes_allocated += v.size();
+                               (escaped ? cur_stats->escaped_strings : cur_stats->plain_strings)++);
+                    continue;
+                }
+
+                if (ch == '[')
+                {
+                    if (!ints)
+                        ints = token_stream.make_int_array();
+                    bool truncated;
+                    if (get_int_array(str, i, IntArray::get_values(ints), truncated))
+                    {
+                        JSON_STATS(cur_stats->max_depth = std::max(cur_stats->max_depth, depth + 1);
+                                   cur_stats->bytes_allocated += IntArray::get_values(ints).size() * sizeof(int64_t));
+                        token_stream.push(ints);
+                        ints = nullptr;
+                        continue;
+                    }
+                    if (partial && truncated)
+                        break;
+                }
+
+                switch (ch)
+                {
+                case '[':
+                case '{':
+                    JSON_STATS(cur_stats->max_depth = std::max(cur_stats->max_depth, ++depth));
+                    token_stream.push(token_stream.make_token(string_to_tag()[std::string(1, ch)]));
+                    break;
+                case ']':
+                case '}':
+                    JSON_STATS(depth -= depth > 0);
+                    token_stream.push(token_stream.make_token(string_to_tag()[std::string(1, ch)]));
+                    break;
+                case ':':
+                case ',':
+                    token_stream.push(token_stream.make_token(string_to_tag()[std::string(1, ch)]));
+                    break;
+                case '\r':
+                case '\n':
+                    token_stream.push(token_stream.make_token(END_LINE));
+                    break;
+                default:
+                    if (isalpha(ch))
+                    {
+                        std::string word = get_word(str, i);
+                        if (word == "null" || word == "false")
+                        {
+                            token_stream.push(token_stream.make_integer(0, word == "null"));
+                        }
+                        else if (word == "true")
+                        {
+                            token_stream.push(token_stream.make_integer(1));
+                        }
+                        else
+                        {
+                            throw std::runtime_error("unexcepted word: " + word);
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            if (ints)
+                token_stream.drop(ints);
+            throw;
+        }
+        if (ints)
+            token_stream.drop(ints);
+        if (!partial)
+            token_stream.push(token_stream.make_token(END_TAG));
+        return i;
+    }
+    TokenStream *build_token_stream(const std::string &str)
+    {
+        std::unique_ptr<TokenStream> token_stream(new TokenStream());
+        build_token_stream(str, *token_stream);
+        return token_stream.release();
+    }
+
+    // checks without throwing that build_token_stream and parse_unit accept str. only deep
+    // nesting and a schema allocate. stricter than the lexer: unknown characters and trailing
+    // values are rejected.
+    class Validator
+    {
+    public:
+        Validator(const std::string &_str, const JSON::ParseOptions &_opts) : str(_str), opts(_opts) {}
+        JSON::ErrorCode run(size_t &pos)
+        {
+            pos = 0;
+            JSON::ErrorCode code = scan(pos);
+            if (code != JSON::ERR_NONE)
+                return code;
+            skip_blank(pos);
+            return pos < str.size() ? JSON::ERR_TRAILING_CHARS : JSON::ERR_NONE;
+        }
+
+    private:
+        // one bit per open container, set for groups
+        class Nesting
+        {
+        public:
+            void push(bool group)
+            {
+                size_t w = depth / 64;
+                if (w >= INLINE_WORDS && spill.size() <= w - INLINE_WORDS)
+                    spill.push_back(0);
+                uint64_t &word = w < INLINE_WORDS ? words[w] : spill[w - INLINE_WORDS];
+                uint64_t bit = uint64_t(1) << (depth % 64);
+                word = group ? (word | bit) : (word & ~bit);
+                depth++;
+            }
+            void pop() { depth--; }
+            bool empty() const { return depth == 0; }
+            size_t size() const { return depth; }
+            bool in_group() const
+            {
+                size_t w = (depth - 1) / 64;
+                uint64_t word = w < INLINE_WORDS ? words[w] : spill[w - INLINE_WORDS];
+                return word >> ((depth - 1) % 64) & 1;
+            }
+
+        private:
+            static const size_t INLINE_WORDS = 16;
+            uint64_t words[INLINE_WORDS];
+            std::vector<uint64_t> spill;
+            size_t depth = 0;
+        };
+
+        void skip_blank(size_t &i) const
+        {
+            while (i < str.size() && (str[i] == ' ' || str[i] == '\t' || str[i] == '\r' || str[i] == '\n'))
+                i++;
+        }
+        JSON::ErrorCode scan_number(size_t &i) const
+        {
+            uint64_t v = 0;
+            while (i < str.size() && isdigit(str[i]))
+            {
+                v = v * 10 + (str[i] - '0');
+                if (v > uint64_t(INT64_MAX))
+                    return JSON::ERR_BAD_NUMBER;
+                i++;
+            }
+            return JSON::ERR_NONE;
+        }
+        JSON::ErrorCode scan_word(size_t &i) const
+        {
+            size_t sp = i;
+            while (i < str.size() && isalpha(str[i]))
+                i++;
+            size_t len = i - sp;
+            if ((len == 4 && (!str.compare(sp, 4, "null") || !str.compare(sp, 4, "true"))) ||
+                (len == 5 && !str.compare(sp, 5, "false")))
+                return JSON::ERR_NONE;
+            i = sp;
+            return JSON::ERR_BAD_WORD;
+        }
+        JSON::ErrorCode scan_string(size_t &i) const
+        {
+            size_t sp = i;
+            size_t decoded = 0;
+            // skip "
+            i++;
+            while (i < str.size() && str[i] != '\"')
+            {
+                if (opts.max_string_length && ++decoded > opts.max_string_length)
+                {
+                    i = sp;
+                    return JSON::ERR_STRING_TOO_LONG;
+                }
+                int len = get_char_size(str[i]);
+                if (len > 1)
+                {
+                    decoded += len - 1;
+                    for (int k = 1; k < len; k++)
+                    {
+                        if (i + k >= str.size())
+                            return JSON::ERR_UNEXPECTED_END;
+                        if ((str[i + k] & 0xC0) != 0x80)
+                        {
+                            i += k;
+                            return JSON::ERR_BAD_UTF8;
+                        }
+                    }
+                    i += len;
+                    continue;
+                }
+                if (str[i] != '\\')
+                {
+                    i++;
+                    continue;
+                }
+                if (++i >= str.size())
+                    return JSON::ERR_UNEXPECTED_END;
+                switch (str[i])
+                {
+                case 'u':
+                {
+                    unsigned code = 0;
+                    for (int k = 1; k <= 4; k++)
+                    {
+                        if (i + k >= str.size())
+                            return JSON::ERR_UNEXPECTED_END;
+                        if (!isxdigit(str[i + k]))
+                        {
+                            i += k;
+                            return JSON::ERR_BAD_ESCAPE;
+                        }
+                        code = code << 4 | (isdigit(str[i + k]) ? str[i + k] - '0' : toupper(str[i + k]) - 'A' + 10);
+                    }
+                    // the UTF8 encoding takes up to 3 bytes
+                    decoded += (code >= 0x80) + (code >= 0x800);
+                    i += 5;
+                    break;
+                }
+                case 'r':
+                case 'n':
+                case 't':
+                case 'b':
+                case 'f':
+                case '\\':
+                case '\"':
+                case '\'':
+                    i++;
+                    break;
+                default:
+                    return JSON::ERR_BAD_ESCAPE;
+                }
+            }
+            if (i >= str.size())
+                return JSON::ERR_UNEXPECTED_END;
+            if (opts.max_string_length && decoded > opts.max_string_length)
+            {
+                i = sp;
+                return JSON::ERR_STRING_TOO_LONG;
+            }
+            // skip "
+            i++;
+            return JSON::ERR_NONE;
+        }
+        JSON::ErrorCode scan_raw(size_t &i) const
+        {
+            size_t lpar = i;
+            // skip (
+            i++;
+            uint64_t sz = 0;
+            size_t sp = i;
+            while (i < str.size() && isdigit(str[i]))
+            {
+                sz = sz * 10 + (str[i] - '0');
+                if (sz > uint64_t(INT32_MAX))
+                    return JSON::ERR_BAD_RAW;
+                i++;
+            }
+            if (i >= str.size())
+                return JSON::ERR_UNEXPECTED_END;
+            if (i == sp || str[i] != ')')
+                return JSON::ERR_BAD_RAW;
+            if (opts.max_raw_size && sz > opts.max_raw_size)
+            {
+                i = lpar;
+                return JSON::ERR_RAW_TOO_LARGE;
+            }
+            if (++i >= str.size())
+                return JSON::ERR_UNEXPECTED_END;
+            if (str[i] != '$')
+                return JSON::ERR_BAD_RAW;
+            // the raw content must be followed by a $
+            if (i + 1 + sz >= str.size())
+            {
+                i = str.size();
+                return JSON::ERR_UNEXPECTED_END;
+            }
+            i += 1 + sz;
+            if (str[i] != '$')
+                return JSON::ERR_BAD_RAW;
+            i++;
+            return JSON::ERR_NONE;
+        }
+        // a string marked as base64 raw data
+        JSON::ErrorCode scan_base64(size_t &i) const
+        {
+            size_t sp = i;
+            size_t from = i + 1 + BASE64_PREFIX_LEN;
+            const char *q = static_cast<const char *>(memchr(str.data() + from, '\"', str.size() - from));
+            if (!q)
+            {
+                i = str.size();
+                return JSON::ERR_UNEXPECTED_END;
+            }
+            size_t len = q - str.data() - from, bad;
+            if (!base64_check(str.data() + from, len, bad))
+            {
+                i = from + bad;
+                return JSON::ERR_BAD_BASE64;
+            }
+            if (opts.max_raw_size && base64_decoded_size(str.data() + from, len) > opts.max_raw_size)
+            {
+                i = sp;
+                return JSON::ERR_RAW_TOO_LARGE;
+            }
+            i = from + len + 1;
+            return JSON::ERR_NONE;
+        }
+        JSON::ErrorCode scan_scalar(size_t &i) const
+        {
+            char ch = str[i];
+            if (ch == '\"' && opts.decode_base64 && !str.compare(i + 1, BASE64_PREFIX_LEN, BASE64_PREFIX))
+                return scan_base64(i);
+            if (ch == '\"')
+                return scan_string(i);
+            if (isdigit(ch))
+                return scan_number(i);
+            if (ch == '(')
+                return scan_raw(i);
+            if (isalpha(ch))
+                return scan_word(i);
+            if (ch == ',' || ch == ':' || ch == ']' || ch == '}')
+                return JSON::ERR_EXPECTED_VALUE;
+            return JSON::ERR_UNEXPECTED_CHAR;
+        }
+        JSON::ErrorCode scan(size_t &i)
+        {
+            Nesting nesting;
+            while (true)
+            {
+                // a value is expected here
+                skip_blank(i);
+                if (i >= str.size())
+                    return JSON::ERR_UNEXPECTED_END;
+                if (opts.max_nodes && ++nodes > opts.max_nodes)
+                    return JSON::ERR_TOO_MANY_NODES;
+                if (opts.schema)
+                {
+                    JSON::ErrorCode code = enter_value(i);
+                    if (code != JSON::ERR_NONE)
+                        return code;
+                }
+                if (str[i] == '[' || str[i] == '{')
+                {
+                    bool group = str[i] == '{';
+                    if (opts.max_depth && nesting.size() >= opts.max_depth)
+                        return JSON::ERR_TOO_DEEP;
+                    nesting.push(group);
+                    i++;
+                    skip_blank(i);
+                    if (i < str.size() && str[i] == (group ? '}' : ']'))
+                    {
+                        if (opts.schema)
+                        {
+                            JSON::ErrorCode code = leave_container();
+                            if (code != JSON::ERR_NONE)
+                                return code;
+                        }
+                        i++;
+                        nesting.pop();
+                    }
+                    else if (group)
+                    {
+                        JSON::ErrorCode code = scan_key(i);
+                        if (code != JSON::ERR_NONE)
+                            return code;
+                        continue;
+                    }
+                    else
+                        continue;
+                }
+                else
+                {
+                    size_t sp = i;
+                    JSON::ErrorCode code = scan_scalar(i);
+                    if (code == JSON::ERR_NONE && opts.schema)
+                        code = check_scalar(sp, i);
+                    if (code != JSON::ERR_NONE)
+                        return code;
+                }
+                // a value is complete, close containers until a comma is found
+                while (true)
+                {
+                    if (nesting.empty())
+                        return JSON::ERR_NONE;
+                    skip_blank(i);
+                    if (i >= str.size())
+                        return JSON::ERR_UNEXPECTED_END;
+                    bool group = nesting.in_group();
+                    if (str[i] == ',')
+                    {
+                        i++;
+                        if (group)
+                        {
+                            JSON::ErrorCode code = scan_key(i);
+                            if (code != JSON::ERR_NONE)
+                                return code;
+                        }
+                        break;
+                    }
+                    if (str[i] != (group ? '}' : ']'))
+                        return JSON::ERR_EXPECTED_COMMA;
+                    if (opts.schema)
+                    {
+                        JSON::ErrorCode code = leave_container();
+                        if (code != JSON::ERR_NONE)
+                            return code;
+                    }
+                    i++;
+                    nesting.pop();
+                }
+            }
+        }
+        // "key" :
+        JSON::ErrorCode scan_key(size_t &i)
+        {
+            skip_blank(i);
+            if (i >= str.size())
+                return JSON::ERR_UNEXPECTED_END;
+            if (str[i] != '\"')
+                return JSON::ERR_EXPECTED_KEY;
+            size_t sp = i;
+            JSON::ErrorCode code = scan_string(i);
+            if (code == JSON::ERR_NONE && opts.schema)
+                code = match_key(sp, i);
+            if (code != JSON::ERR_NONE)
+                return code;
+            skip_blank(i);
+            if (i >= str.size())
+                return JSON::ERR_UNEXPECTED_END;
+            if (str[i] != ':')
+                return JSON::ERR_EXPECTED_COLON;
+            i++;
+            return JSON::ERR_NONE;
+        }
+
+
+        // the schema is followed with one frame per open container
+        typedef JSON::Schema Schema;
+        struct Frame
+        {
+            size_t rule;
+            bool group;
+            // where the required keys seen so far start in seen
+            size_t seen;
+            size_t items;
+        };
+        // str[i] starts a value. the rule of an array element is known only here,
+        // objects and arrays are checked before they are entered
+        JSON::ErrorCode enter_value(size_t i)
+        {
+            if (!frames.empty() && !frames.back().group)
+            {
+                Frame &top = frames.back();
+                next = Schema::ANY;
+                if (top.rule != Schema::ANY)
+                {
+                    const Schema::Rule &r = opts.schema->rules[top.rule];
+                    if (++top.items > r.max_items)
+                        return JSON::ERR_SCHEMA_RANGE;
+                    next = r.items;
+                }
+            }
+            if (str[i] != '[' && str[i] != '{')
+                return JSON::ERR_NONE;
+            bool group = str[i] == '{';
+            const Schema::Rule *r = next == Schema::ANY ? nullptr : &opts.schema->rules[next];
+            if (r && !(r->types & (group ? Schema::T_OBJECT : Schema::T_ARRAY)))
+                return JSON::ERR_SCHEMA_TYPE;
+            frames.push_back(Frame{next, group, seen.size(), 0});
+            if (r && group)
+                seen.resize(seen.size() + (r->required + 63) / 64, 0);
+            return JSON::ERR_NONE;
+        }
+        // at the closing bracket
+        JSON::ErrorCode leave_container()
+        {
+            Frame top = frames.back();
+            frames.pop_back();
+            seen.resize(top.seen);
+            if (top.rule == Schema::ANY)
+                return JSON::ERR_NONE;
+            const Schema::Rule &r = opts.schema->rules[top.rule];
+            if (!top.group)
+                return top.items < r.min_items ? JSON::ERR_SCHEMA_RANGE : JSON::ERR_NONE;
+            for (size_t k = 0; k < r.required; k++)
+            {
+                if (!(seen[top.seen + k / 64] >> (k % 64) & 1))
+                    return JSON::ERR_SCHEMA_REQUIRED;
+            }
+            return JSON::ERR_NONE;
+        }
+        // the key str[sp, i) picks the rule of the value after it, i goes back to sp on failure
+        JSON::ErrorCode match_key(size_t sp, size_t &i)
+        {
+            Frame &top = frames.back();
+            next = Schema::ANY;
+            if (top.rule == Schema::ANY)
+                return JSON::ERR_NONE;
+            const Schema::Rule &r = opts.schema->rules[top.rule];
+            const char *key = str.data() + sp + 1;
+            size_t len = i - sp - 2;
+            if (memchr(key, '\\', len))
+            {
+                int pos = int(sp);
+                key_buf.clear();
+                get_string(str, pos, key_buf);
+                key = key_buf.data();
+                len = key_buf.size();
+            }
+            auto before = [&](const Schema::Property &p, const char *) {
+                return p.key.compare(0, std::string::npos, key, len) < 0;
+            };
+            auto it = std::lower_bound(r.properties.begin(), r.properties.end(), key, before);
+            if (it != r.properties.end() && !it->key.compare(0, std::string::npos, key, len))
+            {
+                next = it->rule;
+                if (it->bit != Schema::ANY)
+                    seen[top.seen + it->bit / 64] |= uint64_t(1) << (it->bit % 64);
+                return JSON::ERR_NONE;
+            }
+            if (r.additional)
+                return JSON::ERR_NONE;
+            i = sp;
+            return JSON::ERR_SCHEMA_UNKNOWN_KEY;
+        }
+        // the scalar str[sp, i) against the rule picked for it, i goes back to sp on failure
+        JSON::ErrorCode check_scalar(size_t sp, size_t &i) const
+        {
+            if (next == Schema::ANY)
+                return JSON::ERR_NONE;
+            const Schema::Rule &r = opts.schema->rules[next];
+            char ch = str[sp];
+            unsigned type;
+            // chars of a string, bytes of raw data
+            size_t size = 0;
+            bool sized = r.min_length || r.max_length != size_t(-1);
+            int64_t v = 0;
+            if (ch == '\"' && opts.decode_base64 && !str.compare(sp + 1, BASE64_PREFIX_LEN, BASE64_PREFIX))
+            {
+                type = Schema::T_RAW;
+                size = base64_decoded_size(str.data() + sp + 1 + BASE64_PREFIX_LEN, i - sp - 2 - BASE64_PREFIX_LEN);
+            }
+            else if (ch == '\"')
+            {
+                type = Schema::T_STRING;
+                for (size_t k = sp + 1; sized && k < i - 1; k++)
+                {
+                    if (str[k] == '\\')
+                        k += str[k + 1] == 'u' ? 5 : 1;
+                    size += (str[k] & 0xC0) != 0x80;
+                }
+            }
+            else if (ch == '(')
+            {
+                type = Schema::T_RAW;
+                for (size_t k = sp + 1; isdigit(str[k]); k++)
+                    size = size * 10 + (str[k] - '0');
+            }
+            else if (isdigit(ch))
+            {
+                type = Schema::T_INTEGER;
+                for (size_t k = sp; k < i; k++)
+                    v = v * 10 + (str[k] - '0');
+            }
+            else
+                type = ch == 'n' ? Schema::T_NULL : Schema::T_BOOLEAN;
+            JSON::ErrorCode code = JSON::ERR_NONE;
+            if (!(r.types & type))
+                code = JSON::ERR_SCHEMA_TYPE;
+            else if (type == Schema::T_INTEGER && (v < r.minimum || v > r.maximum))
+                code = JSON::ERR_SCHEMA_RANGE;
+            else if ((type == Schema::T_STRING || type == Schema::T_RAW) && (size < r.min_length || size > r.max_length))
+                code = JSON::ERR_SCHEMA_RANGE;
+            if (code != JSON::ERR_NONE)
+                i = sp;
+            return code;
+        }
+
+        const std::string &str;
+        const JSON::ParseOptions &opts;
+        size_t nodes = 0;
+        std::vector<Frame> frames;
+        std::vector<uint64_t> seen;
+        // the rule of the value scanned next
+        size_t next = 0;
+        std::string key_buf;
+    };
+
+}
+namespace Parser
+{
+    // Header
+    // statement
+    enum NodeType : uint8_t
+    {
+        STRING = 1,
+        INT = 2,
+        ARRAY = 3,
+        GROUP = 4,
+        RAW = 5
+    };
+    // bits of Node::flags
+    enum NodeFlag : uint8_t
+    {
+        // an Integer parsed from null, merge patches treat it as removal
+        NULL_VALUE = 1,
+        // changed since the node was last written with to_string_cached, new nodes start dirty.
+        // a dirty node always has dirty ancestors
+        DIRTY = 2,
+        // hashed and unchanged since, objects and arrays keep the hash. a node
+        // without it never has hashed ancestors
+        HASH_VALID = 4,
+        // an array keeping indexes, touch() tells it which element changed
+        INDEXED = 8
+    };
+    // the last output of an object or array, valid while the container is clean
+    struct OutputCache
+    {
+        std::string text;
+        std::string indent;
+        size_t level;
+    };
+
+    // the storage of a document, see JSON::String
+    typedef JSON::String Text;
+#ifdef JSON_LITE_PMR
+    template <typename T>
+    using Vec = std::pmr::vector<T>;
+    // set by JSON::ResourceScope
+    thread_local std::pmr::memory_resource *cur_resource = nullptr;
+    // where nodes made now come from
+    std::pmr::memory_resource *resource()
+    {
+        return cur_resource ? cur_resource : std::pmr::get_default_resource();
+    }
+    std::pmr::polymorphic_allocator<char> alloc()
+    {
+        return resource();
+    }
+#else
+    template <typename T>
+    using Vec = std::vector<T>;
+    std::allocator<char> alloc()
+    {
+        return std::allocator<char>();
+    }
+#endif
+    // for the interfaces taking std::string, a copy only with JSON_LITE_PMR
+#ifdef JSON_LITE_PMR
+    std::string to_std(const Text &str)
+    {
+        return std::string(str.data(), str.size());
+    }
+#else
+    const std::string &to_std(const std::string &str)
+    {
+        return str;
+    }
+#endif
+    // orders a stored key before a looked up one, without converting either
+    int key_compare(const Text &a, const std::string &b)
+    {
+        return a.compare(0, a.size(), b.data(), b.size());
+    }
+
+    class Node;
+    class NodePool;
+    // deletes whole trees iteratively, pending is consumed, null entries are skipped
+    void release(Node *node);
+    void release(std::vector<Node *> &pending);
+    // elem of an indexed array is about to change, its keys are redone by the next lookup
+    void element_changed(Node *array, Node *elem);
+
+    class Node
+    {
+    public:
+        Node(NodeType nt) : type(nt), flags(DIRTY) {}
+        int64_t &get_int();
+        Text &get_str();
+        Vec<unsigned char> &get_raw();
+        Node *at(const std::string &str)
+        {
+            return operator[](str);
+        }
+        Node *at(size_t idx)
+        {
+            return operator[](idx);
+        }
+        Node *operator[](const std::string &str);
+        Node *operator[](size_t idx);
+
+        NodeType get_type() const { return type; }
+        bool is_null() const { return flags & NULL_VALUE; }
+        bool is_dirty() const { return flags & DIRTY; }
+        void clean() { flags &= ~DIRTY; }
+        bool is_hashed() const { return flags & HASH_VALID; }
+        void set_hashed() { flags |= HASH_VALID; }
+        // marks the node and its ancestors dirty and drops their hashes,
+        // stops at the first one already in that state. an indexed array on the way,
+        // or the one it stops at, learns which of its elements changed
+        void touch()
+        {
+            for (Node *cur = this, *from = nullptr; cur; from = cur, cur = cur->parent)
+            {
+                if (from && (cur->flags & INDEXED))
+                    element_changed(cur, from);
+                if ((cur->flags & (DIRTY | HASH_VALID)) == DIRTY)
+                    break;
+                cur->flags = (cur->flags | DIRTY) & ~HASH_VALID;
+            }
+        }
+        // the object or array holding this node, nullptr for a root
+        Node *parent = nullptr;
+
+    protected:
+        // no vtable, release() deletes a node through its concrete type
+        ~Node() {}
+
+    private:
+        friend Node *parse_scalar(Lexer::TokenStream &ts, NodePool *pool, bool base64);
+        friend class NodePool;
+        friend class Array;
+        friend class Projector;
+        NodeType type;
+        uint8_t flags;
+    };
+    // the cache slot of an object or array
+    OutputCache *&output_cache(Node *node);
+    // structural hash, object members are sorted so key order does not matter.
+    // cached in objects and arrays until they are touched
+    uint64_t hash(Node *node);
+    // deep comparison, skips subtrees whose cached hashes differ
+    bool equal(Node *a, Node *b);
+
+    // 24 bytes, the type tag and flags share the first word with padding.
+    // the other nodes find their resource through their container
+    class Integer : public Node
+    {
+    public:
+        Integer(int64_t v) : Node(INT), integer(v) {}
+        static int64_t &get_integer(Node *node);
+#ifdef JSON_LITE_PMR
+        std::pmr::memory_resource *const res = resource();
+#endif
+
+    private:
+        int64_t integer;
+    };
+    // 48 bytes, which malloc rounds to the same 64-byte block the old 56-byte
+    // node took. text must stay a std::string, get_str() hands out a reference
+    class Unit : public Node
+    {
+    public:
+#ifdef JSON_LITE_PMR
+        Unit(const std::string &str) : Node(STRING), text(str.data(), str.size(), alloc()) {}
+#else
+        Unit(const std::string &str) : Node(STRING), text(str) {}
+        Unit(std::string &&str) : Node(STRING), text(std::move(str)) {}
+#endif
+        static Text &get_str(Node *node);
+
+    private:
+        Text text;
+    };
+    // 56 bytes plus 40 per member, the std::map it replaced took 64 plus 72 per member
+    class Group : public Node
+    {
+    public:
+        // sorted by key and kept in one block, lookups are a binary search
+        typedef Vec<std::pair<Text, Node *>> Members;
+        // duplicated keys keep their first value, like std::map::insert
+        Group(Members &&tab);
+        Node *operator[](const std::string &str) const;
+        Node *find(const std::string &str) const;
+        // tries member_table[hint] before searching, hint is updated on a hit
+        Node *find(const std::string &str, size_t &hint) const;
+        // false if the key is already present
+        bool insert(const std::string &str, Node *node);
+        // inserts or overwrites, returns the previous value or nullptr
+        Node *replace(const std::string &str, Node *node);
+        // unlinks the value and hands it to the caller, nullptr if the key is absent
+        Node *detach(const std::string &str);
+        ~Group();
+        size_t count() const;
+
+    private:
+        // sorts the table, drops duplicated keys and adopts the members
+        void normalize();
+        // points the parent of every member here
+        void adopt();
+        friend class NodePool;
+        friend class ::JSON;
+        friend class ::JSON::View;
+        friend void release(std::vector<Node *> &pending);
+#ifdef JSON_LITE_PMR
+        friend std::pmr::memory_resource *resource_of(Node *node);
+#endif
+        friend OutputCache *&output_cache(Node *node);
+        friend uint64_t hash(Node *node);
+        friend bool equal(Node *a, Node *b);
+        Members member_table;
+        OutputCache *cache = nullptr;
+        uint64_t hash_value = 0;
+    };
+    // a keyed lookup on one field of the elements of an array, see JSON::create_index.
+    // every element in keys is hashed, so the first edit inside it reaches the array
+    struct ArrayIndex
+    {
+        ArrayIndex(const std::string &_path) : path(_path), field(_path) {}
+        std::string path;
+        JSON::Pointer field;
+        // the hash of the field value, elements without the field are left out
+        std::multimap<uint64_t, Node *> keys;
+        std::map<Node *, std::multimap<uint64_t, Node *>::iterator> slots;
+        // elements touched since they were keyed, the next lookup keys them again
+        std::vector<Node *> changed;
+        // the next index of the same array
+        ArrayIndex *next = nullptr;
+    };
+    // 72 bytes, up from 40 for the packed buffer, cache, hash and index.
+    // elements stay Node*, handles point at them and must survive an insert
+    class Array : public Node
+    {
+    public:
+        Array(const std::vector<Node *> &ele);
+        Array(std::vector<Node *> &&ele);
+        // packed storage, the values are not nodes
+        Array(std::vector<int64_t> &&vals);
+#ifdef JSON_LITE_PMR
+        Array(const Vec<Node *> &ele);
+#endif
+        Node *operator[](size_t idx);
+        ~Array();
+        size_t length() const;
+        bool is_packed() const { return packed != nullptr; }
+        // turns packed values into Integer nodes, for anything that needs a Node*
+        void unpack();
+        // the array takes node, idx may be length(). a packed array is unpacked
+        void insert(size_t idx, Node *node);
+        // returns the previous element. owned tells no handle refers to node, an
+        // integer is then stored into a packed array and node freed
+        Node *replace(size_t idx, Node *node, bool owned = false);
+        // unlinks the element and hands it to the caller
+        Node *detach(size_t idx);
+        // the index on path, built if the array has none yet. the array is unpacked
+        ArrayIndex *get_index(const std::string &path);
+        // false if there is no index on path
+        bool drop_index(const std::string &path);
+        // keys the elements touched since the last lookup
+        void refresh(ArrayIndex *idx);
+
+    private:
+        friend void element_changed(Node *array, Node *elem);
+        void index_element(Node *elem);
+        void unindex_element(Node *elem);
+        friend class NodePool;
+        friend class ::JSON;
+        friend class ::JSON::View;
+        friend void release(std::vector<Node *> &pending);
+#ifdef JSON_LITE_PMR
+        friend std::pmr::memory_resource *resource_of(Node *node);
+#endif
+        friend OutputCache *&output_cache(Node *node);
+        friend uint64_t hash(Node *node);
+        friend bool equal(Node *a, Node *b);
+        Vec<Node *> elements;
+        Vec<int64_t> *packed = nullptr;
+        OutputCache *cache = nullptr;
+        uint64_t hash_value = 0;
+        ArrayIndex *index = nullptr;
+    };
+    // extend json. (length)$raw_data$
+    class Bytes : public Node
+    {
+    public:
+#ifdef JSON_LITE_PMR
+        Bytes(const std::vector<unsigned char> &tmp) : Node(RAW), data(tmp.begin(), tmp.end(), alloc()) {}
+        Bytes(const Vec<unsigned char> &tmp) : Node(RAW), data(tmp.begin(), tmp.end(), alloc()) {}
+#else
+        Bytes(const std::vector<unsigned char> &tmp) : Node(RAW), data(tmp) {}
+        Bytes(std::vector<unsigned char> &&tmp) : Node(RAW), data(std::move(tmp)) {}
+#endif
+        size_t raw_length() const
+        {
+            return data.size();
+        }
+        static Vec<unsigned char> &get_bytes(Node *node)
+        {
+            return static_cast<Bytes *>(node)->data;
+        }
+
+    private:
+        Vec<unsigned char> data;
+    };
+
+    // nodes and packed buffers are made and freed through these, so that with
+    // JSON_LITE_PMR they come from the current resource and go back to their own
+#ifdef JSON_LITE_PMR
+    std::pmr::memory_resource *resource_of(Node *node);
+    template <typename T, typename... Args>
+    T *create(Args &&...args)
+    {
+        std::pmr::memory_resource *res = resource();
+        void *p = res->allocate(sizeof(T), alignof(T));
+        try
+        {
+            return new (p) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            res->deallocate(p, sizeof(T), alignof(T));
+            throw;
+        }
+    }
+    template <typename T>
+    void destroy(T *p, std::pmr::memory_resource *res)
+    {
+        p->~T();
+        res->deallocate(p, sizeof(T), alignof(T));
+    }
+    template <typename T>
+    void destroy(T *node)
+    {
+        destroy(node, resource_of(node));
+    }
+    inline void destroy(Vec<int64_t> *packed)
+    {
+        destroy(packed, packed->get_allocator().resource());
+    }
+    // nodes made in the block come from the resource of node
+    class SameResource
+    {
+    public:
+        SameResource(Node *node) : prev(cur_resource) { cur_resource = resource_of(node); }
+        ~SameResource() { cur_resource = prev; }
+
+    private:
+        std::pmr::memory_resource *prev;
+    };
+#else
+    template <typename T, typename... Args>
+    T *create(Args &&...args)
+    {
+        return new T(std::forward<Args>(args)...);
+    }
+    template <typename T>
+    void destroy(T *p)
+    {
+        delete p;
+    }
+    class SameResource
+    {
+    public:
+        SameResource(Node *) {}
+    };
+#endif
+}
+
+namespace Parser
+{
+    int64_t &Node::get_int()
+    {
+        if (type == INT)
+        {
+            return Integer::get_integer(this);
+        }
+        else
+            throw std::runtime_error("type not matched");
+    }
+    Vec<unsigned char> &Node::get_raw()
+    {
+        if (type == RAW)
+        {
+            return Bytes::get_bytes(this);
+        }
+        else
+        {
+            throw std::runtime_error("type not matched excepted a bytes");
+        }
+    }
+    Text &Node::get_str()
+    {
+        if (type == STRING)
+        {
+            return Unit::get_str(this);
+        }
+        else
+            throw std::runtime_error("type not matched");
+    }
+    Node *Node::operator[](const std::string &str)
+    {
+        if (type != GROUP)
+        {
+            throw std::runtime_error("type not matched, expected an array!");
+        }
+        return static_cast<Group *>(this)->operator[](str);
+    }
+    Node *Node::operator[](size_t idx)
+    {
+        if (type != ARRAY)
+            throw std::runtime_error("type not matched, expected an array!");
+        return static_cast<Array *>(this)->operator[](idx);
+    }
+    OutputCache *&output_cache(Node *node)
+    {
+        if (node->get_type() == ARRAY)
+            return static_cast<Array *>(node)->cache;
+        return static_cast<Group *>(node)->cache;
+    }
+    namespace
+    {
+        uint64_t hash_int(int64_t v, bool null)
+        {
+            return mix64(uint64_t(v) ^ (null ? 0x6e756c6cULL << 32 : uint64_t(INT) << 56));
+        }
+    }
+    uint64_t hash(Node *root)
+    {
+        // objects and arrays being hashed, children fold into h in order
+        struct Frame
+        {
+            Node *node;
+            size_t idx;
+            uint64_t h;
+        };
+        std::vector<Frame> stack;
+        Node *cur = root;
+        while (true)
+        {
+            uint64_t value = 0;
+            bool ready = true;
+            switch (cur->get_type())
+            {
+            case INT:
+                value = hash_int(Integer::get_integer(cur), cur->is_null());
+                break;
+            case STRING:
+            {
+                auto &str = Unit::get_str(cur);
+                value = hash_bytes(str.data(), str.size(), STRING);
+                break;
+            }
+            case RAW:
+            {
+                auto &data = Bytes::get_bytes(cur);
+                value = hash_bytes(data.data(), data.size(), RAW);
+                break;
+            }
+            case ARRAY:
+            {
+                auto arr = static_cast<Array *>(cur);
+                if (arr->is_hashed())
+                    value = arr->hash_value;
+                else if (arr->packed)
+                {
+                    // the same hash as the unpacked Integer nodes would give
+                    value = mix64(uint64_t(ARRAY) << 56 ^ arr->packed->size());
+                    for (auto v : *arr->packed)
+                        value = hash_combine(value, hash_int(v, false));
+                    arr->hash_value = value;
+                }
+                else
+                {
+                    stack.push_back({cur, 0, mix64(uint64_t(ARRAY) << 56 ^ arr->elements.size())});
+                    ready = false;
+                }
+                break;
+            }
+            case GROUP:
+            {
+                auto group = static_cast<Group *>(cur);
+                if (group->is_hashed())
+                    value = group->hash_value;
+                else
+                {
+                    stack.push_back({cur, 0, mix64(uint64_t(GROUP) << 56 ^ group->member_table.size())});
+                    ready = false;
+                }
+                break;
+            }
+            }
+            // no write for nodes already hashed, a frozen snapshot is only read
+            if (ready && !cur->is_hashed())
+                cur->set_hashed();
+
+            // fold the value into its container, then find the next child to hash
+            cur = nullptr;
+            while (!cur)
+            {
+                if (ready)
+                {
+                    if (stack.empty())
+                        return value;
+                    stack.back().h = hash_combine(stack.back().h, value);
+                    stack.back().idx++;
+                }
+                Frame &top = stack.back();
+                if (top.node->get_type() == ARRAY)
+                {
+                    auto &elements = static_cast<Array *>(top.node)->elements;
+                    if (top.idx < elements.size())
+                        cur = elements[top.idx];
+                }
+                else
+                {
+                    auto &table = static_cast<Group *>(top.node)->member_table;
+                    if (top.idx < table.size())
+                    {
+                        auto &key = table[top.idx].first;
+                        top.h = hash_combine(top.h, hash_bytes(key.data(), key.size(), GROUP));
+                        cur = table[top.idx].second;
+                    }
+                }
+                if (cur)
+                    break;
+                value = top.h;
+                if (top.node->get_type() == ARRAY)
+                    static_cast<Array *>(top.node)->hash_value = value;
+                else
+                    static_cast<Group *>(top.node)->hash_value = value;
+                top.node->set_hashed();
+                stack.pop_back();
+                ready = true;
+            }
+        }
+    }
+    bool equal(Node *a, Node *b)
+    {
+        std::vector<std::pair<Node *, Node *>> pending(1, std::make_pair(a, b));
+        while (!pending.empty())
+        {
+            a = pending.back().first;
+            b = pending.back().second;
+            pending.pop_back();
+            if (a == b)
+                continue;
+            if (a->get_type() != b->get_type())
+                return false;
+            switch (a->get_type())
+            {
+            case INT:
+                if (Integer::get_integer(a) != Integer::get_integer(b) || a->is_null() != b->is_null())
+                    return false;
+                break;
+            case STRING:
+                if (Unit::get_str(a) != Unit::get_str(b))
+                    return false;
+                break;
+            case RAW:
+                if (Bytes::get_bytes(a) != Bytes::get_bytes(b))
+                    return false;
+                break;
+            case ARRAY:
+            {
+                auto x = static_cast<Array *>(a), y = static_cast<Array *>(b);
+                if ((x->is_hashed() && y->is_hashed() && x->hash_value != y->hash_value) || x->length() != y->length())
+                    return false;
+                if (x->packed && y->packed)
+                {
+                    if (*x->packed != *y->packed)
+                        return false;
+                    break;
+                }
+                // a packed array equals Integer nodes holding the same values
+                if (y->packed)
+                    std::swap(x, y);
+                for (size_t k = 0; k < y->elements.size(); k++)
+                {
+                    if (!x->packed)
+                        pending.emplace_back(x->elements[k], y->elements[k]);
+                    else if (y->elements[k]->get_type() != INT || y->elements[k]->is_null() ||
+                             Integer::get_integer(y->elements[k]) != (*x->packed)[k])
+                        return false;
+                }
+                break;
+            }
+            case GROUP:
+            {
+                auto &x = *static_cast<Group *>(a), &y = *static_cast<Group *>(b);
+                if ((x.is_hashed() && y.is_hashed() && x.hash_value != y.hash_value) || x.member_table.size() != y.member_table.size())
+                    return false;
+                for (size_t k = 0; k < x.member_table.size(); k++)
+                {
+                    if (x.member_table[k].first != y.member_table[k].first)
+                        return false;
+                    pending.emplace_back(x.member_table[k].second, y.member_table[k].second);
+                }
+                break;
+            }
+            }
+        }
+        return true;
+    }
+    void release(Node *node)
+    {
+        std::vector<Node *> pending(1, node);
+        release(pending);
+    }
+    void release(std::vector<Node *> &pending)
+    {
+        // children are detached before delete, so no destructor recurses
+        while (!pending.empty())
+        {
+            Node *cur = pending.back();
+            pending.pop_back();
+            if (!cur)
+                continue;
+            if (cur->get_type() == ARRAY)
+            {
+                auto &elements = static_cast<Array *>(cur)->elements;
+                pending.insert(pending.end(), elements.begin(), elements.end());
+                elements.clear();
+            }
+            else if (cur->get_type() == GROUP)
+            {
+                auto &table = static_cast<Group *>(cur)->member_table;
+                for (auto &it : table)
+                    pending.push_back(it.second);
+                table.clear();
+            }
+            switch (cur->get_type())
+            {
+            case INT:
+                destroy(static_cast<Integer *>(cur));
+                break;
+            case STRING:
+                destroy(static_cast<Unit *>(cur));
+                break;
+            case ARRAY:
+                destroy(static_cast<Array *>(cur));
+                break;
+            case GROUP:
+                destroy(static_cast<Group *>(cur));
+                break;
+            case RAW:
+                destroy(static_cast<Bytes *>(cur));
+                break;
+            }
+        }
+    }
+    // Integer
+    int64_t &Integer::get_integer(Node *node)
+    {
+        return static_cast<Integer *>(node)->integer;
+    }
+    // Unit
+    Text &Unit::get_str(Node *node)
+    {
+        return static_cast<Unit *>(node)->text;
+    }
+#ifdef JSON_LITE_PMR
+    std::pmr::memory_resource *resource_of(Node *node)
+    {
+        switch (node->get_type())
+        {
+        case INT:
+            return static_cast<Integer *>(node)->res;
+        case STRING:
+            return Unit::get_str(node).get_allocator().resource();
+        case ARRAY:
+            return static_cast<Array *>(node)->elements.get_allocator().resource();
+        case GROUP:
+            return static_cast<Group *>(node)->member_table.get_allocator().resource();
+        default:
+            return Bytes::get_bytes(node).get_allocator().resource();
+        }
+    }
+#endif
+    // Array
+#ifdef JSON_LITE_PMR
+    Array::Array(const std::vector<Node *> &ele) : Node(ARRAY), elements(ele.begin(), ele.end(), alloc())
+    {
+        for (auto it : elements)
+            it->parent = this;
+    }
+    Array::Array(std::vector<Node *> &&ele) : Array(ele) {}
+    Array::Array(const Vec<Node *> &ele) : Node(ARRAY), elements(ele.begin(), ele.end(), alloc())
+    {
+        for (auto it : elements)
+            it->parent = this;
+    }
+    Array::Array(std::vector<int64_t> &&vals) : Node(ARRAY), elements(alloc()), packed(create<Vec<int64_t>>(vals.begin(), vals.end(), alloc())) {}
+#else
+    Array::Array(const std::vector<Node *> &ele) : Node(ARRAY), elements(ele)
+    {
+        for (auto it : elements)
+            it->parent = this;
+    }
+    Array::Array(std::vector<Node *> &&ele) : Node(ARRAY), elements(std::move(ele))
+    {
+        for (auto it : elements)
+            it->parent = this;
+    }
+    Array::Array(std::vector<int64_t> &&vals) : Node(ARRAY), packed(new std::vector<int64_t>(std::move(vals))) {}
+#endif
+    Node *Array::operator[](size_t idx)
+    {
+        unpack();
+        if (idx >= elements.size())
+            throw std::runtime_error("Array out of range!");
+        return elements[idx];
+    }
+    Array::~Array()
+    {
+        if (packed)
+            destroy(packed);
+        delete cache;
+        while (index)
+        {
+            ArrayIndex *next = index->next;
+            delete index;
+            index = next;
+        }
+        if (!elements.empty())
+        {
+            std::vector<Node *> pending(elements.begin(), elements.end());
+            elements.clear();
+            release(pending);
+        }
+    }
+    size_t Array::length() const
+    {
+        return packed ? packed->size() : elements.size();
+    }
+    void Array::unpack()
+    {
+        if (!packed)
+            return;
+        SameResource use(this);
+        elements.reserve(elements.size() + packed->size());
+        for (auto v : *packed)
+        {
+            elements.push_back(create<Integer>(v));
+            elements.back()->parent = this;
+            // the output and hash are unchanged, the elements must not break the flag invariants
+            if (!is_dirty())
+                elements.back()->clean();
+            if (is_hashed())
+                elements.back()->set_hashed();
+        }
+        destroy(packed);
+        packed = nullptr;
+    }
+    void Array::insert(size_t idx, Node *node)
+    {
+        if (idx > length())
+            throw std::runtime_error("Array out of range!");
+        touch();
+        // the caller's handle may still refer to node, so it is kept as a node
+        unpack();
+        node->parent = this;
+        elements.insert(elements.begin() + idx, node);
+        if (index)
+            index_element(node);
+    }
+    Node *Array::replace(size_t idx, Node *node, bool owned)
+    {
+        if (idx >= length())
+            throw std::runtime_error("Array out of range!");
+        touch();
+        // a node that may still have a handle is kept, like insert does
+        if (owned && packed && node->get_type() == INT && !node->is_null())
+        {
+            SameResource use(this);
+            Node *old = create<Integer>((*packed)[idx]);
+            (*packed)[idx] = node->get_int();
+            release(node);
+            return old;
+        }
+        unpack();
+        node->parent = this;
+        std::swap(elements[idx], node);
+        node->parent = nullptr;
+        if (index)
+        {
+            unindex_element(node);
+            index_element(elements[idx]);
+        }
+        return node;
+    }
+    Node *Array::detach(size_t idx)
+    {
+        if (idx >= length())
+            throw std::runtime_error("Array out of range!");
+        touch();
+        if (packed)
+        {
+            SameResource use(this);
+            Node *old = create<Integer>((*packed)[idx]);
+            packed->erase(packed->begin() + idx);
+            return old;
+        }
+        Node *old = elements[idx];
+        elements.erase(elements.begin() + idx);
+        old->parent = nullptr;
+        if (index)
+            unindex_element(old);
+        return old;
+    }
+    namespace
+    {
+        // the value at the field of elem, nullptr if the path does not exist
+        Node *index_field(const ArrayIndex *idx, Node *elem)
+        {
+            const JSON::Pointer &field = idx->field;
+            for (size_t k = 0; k < field.size() && elem; k++)
+            {
+                if (elem->get_type() == GROUP)
+                    elem = static_cast<Group *>(elem)->find(field.key(k));
+                else if (elem->get_type() == ARRAY && field.index(k) < static_cast<Array *>(elem)->length())
+                    elem = static_cast<Array *>(elem)->operator[](field.index(k));
+                else
+                    elem = nullptr;
+            }
+            return elem;
+        }
+        void add_key(ArrayIndex *idx, Node *elem)
+        {
+            // hashing sets HASH_VALID down the element, so its next touch() climbs to the array
+            hash(elem);
+            Node *value = index_field(idx, elem);
+            if (value)
+                idx->slots[elem] = idx->keys.emplace(hash(value), elem);
+        }
+        void remove_key(ArrayIndex *idx, Node *elem)
+        {
+            auto it = idx->slots.find(elem);
+            if (it == idx->slots.end())
+                return;
+            idx->keys.erase(it->second);
+            idx->slots.erase(it);
+        }
+    }
+    ArrayIndex *Array::get_index(const std::string &path)
+    {
+        for (ArrayIndex *idx = index; idx; idx = idx->next)
+        {
+            if (idx->path == path)
+                return idx;
+        }
+        std::unique_ptr<ArrayIndex> idx(new ArrayIndex(path));
+        unpack();
+        for (auto it : elements)
+            add_key(idx.get(), it);
+        idx->next = index;
+        index = idx.release();
+        flags |= INDEXED;
+        return index;
+    }
+    bool Array::drop_index(const std::string &path)
+    {
+        for (ArrayIndex **link = &index; *link; link = &(*link)->next)
+        {
+            if ((*link)->path != path)
+                continue;
+            ArrayIndex *idx = *link;
+            *link = idx->next;
+            delete idx;
+            if (!index)
+                flags &= ~INDEXED;
+            return true;
+        }
+        return false;
+    }
+    void Array::refresh(ArrayIndex *idx)
+    {
+        // an element shows up again for every edit after it was keyed, once is enough
+        std::sort(idx->changed.begin(), idx->changed.end());
+        idx->changed.erase(std::unique(idx->changed.begin(), idx->changed.end()), idx->changed.end());
+        for (auto it : idx->changed)
+        {
+            remove_key(idx, it);
+            add_key(idx, it);
+        }
+        idx->changed.clear();
+    }
+    void Array::index_element(Node *elem)
+    {
+        for (ArrayIndex *idx = index; idx; idx = idx->next)
+            add_key(idx, elem);
+    }
+    void Array::unindex_element(Node *elem)
+    {
+        for (ArrayIndex *idx = index; idx; idx = idx->next)
+        {
+            remove_key(idx, elem);
+            idx->changed.erase(std::remove(idx->changed.begin(), idx->changed.end(), elem), idx->changed.end());
+        }
+    }
+    void element_changed(Node *array, Node *elem)
+    {
+        for (ArrayIndex *idx = static_cast<Array *>(array)->index; idx; idx = idx->next)
+            idx->changed.push_back(elem);
+    }
+    // Group
+    namespace
+    {
+        typedef Group::Members::value_type Member;
+        bool key_less(const Member &a, const Member &b)
+        {
+            return a.first < b.first;
+        }
+        bool key_equal(const Member &a, const Member &b)
+        {
+            return a.first == b.first;
+        }
+        // for lower_bound, compares with the key without copying it
+        bool key_before(const Member &a, const std::string &key)
+        {
+            return key_compare(a.first, key) < 0;
+        }
+    }
+    // a table from another resource is copied into the current one
+    Group::Group(Members &&tab) : Node(GROUP), member_table(std::move(tab), alloc())
+    {
+        normalize();
+    }
+    void Group::normalize()
+    {
+        if (std::is_sorted(member_table.begin(), member_table.end(), key_less) &&
+            std::adjacent_find(member_table.begin(), member_table.end(), key_equal) == member_table.end())
+        {
+            adopt();
+            return;
+        }
+        // stable_sort takes a buffer from the heap, small objects are sorted in place
+        if (member_table.size() <= 16)
+        {
+            for (size_t i = 1; i < member_table.size(); i++)
+                for (size_t j = i; j > 0 && key_less(member_table[j], member_table[j - 1]); j--)
+                    std::swap(member_table[j], member_table[j - 1]);
+        }
+        else
+            std::stable_sort(member_table.begin(), member_table.end(), key_less);
+        std::vector<Node *> dropped;
+        auto last = member_table.begin();
+        for (auto it = member_table.begin(); it != member_table.end(); ++it)
+        {
+            if (it != member_table.begin() && it->first == (last - 1)->first)
+                dropped.push_back(it->second);
+            else
+            {
+                if (last != it)
+                    *last = std::move(*it);
+                ++last;
+            }
+        }
+        member_table.erase(last, member_table.end());
+        release(dropped);
+        adopt();
+    }
+    void Group::adopt()
+    {
+        for (auto &it : member_table)
+            it.second->parent = this;
+    }
+    Node *Group::find(const std::string &str) const
+    {
+        auto it = std::lower_bound(member_table.begin(), member_table.end(), str, key_before);
+        if (it == member_table.end() || key_compare(it->first, str))
+            return nullptr;
+        return it->second;
+    }
+    Node *Group::find(const std::string &str, size_t &hint) const
+    {
+        if (hint < member_table.size() && !key_compare(member_table[hint].first, str))
+            return member_table[hint].second;
+        auto it = std::lower_bound(member_table.begin(), member_table.end(), str, key_before);
+        if (it == member_table.end() || key_compare(it->first, str))
+            return nullptr;
+        hint = it - member_table.begin();
+        return it->second;
+    }
+    Node *Group::operator[](const std::string &str) const
+    {
+        Node *ret = find(str);
+        if (!ret)
+        {
+            throw std::runtime_error("key " + str + " not found");
+        }
+        return ret;
+    }
+    bool Group::insert(const std::string &str, Node *node)
+    {
+        auto it = std::lower_bound(member_table.begin(), member_table.end(), str, key_before);
+        if (it != member_table.end() && !key_compare(it->first, str))
+            return false;
+        touch();
+        node->parent = this;
+        member_table.emplace(it, str, node);
+        return true;
+    }
+    Node *Group::replace(const std::string &str, Node *node)
+    {
+        auto it = std::lower_bound(member_table.begin(), member_table.end(), str, key_before);
+        touch();
+        node->parent = this;
+        if (it != member_table.end() && !key_compare(it->first, str))
+        {
+            std::swap(it->second, node);
+            node->parent = nullptr;
+            return node;
+        }
+        member_table.emplace(it, str, node);
+        return nullptr;
+    }
+    Node *Group::detach(const std::string &str)
+    {
+        auto it = std::lower_bound(member_table.begin(), member_table.end(), str, key_before);
+        if (it == member_table.end() || key_compare(it->first, str))
+            return nullptr;
+        Node *ret = it->second;
+        member_table.erase(it);
+        touch();
+        ret->parent = nullptr;
+        return ret;
+    }
+    Group::~Group()
+    {
+        delete cache;
+        std::vector<Node *> pending;
+        pending.reserve(member_table.size());
+        for (auto &it : member_table)
+            pending.push_back(it.second);
+        member_table.clear();
+        release(pending);
+    }
+    size_t Group::count() const
+    {
+        return member_table.size();
+    }
+
+    // an array or group whose closing bracket has not been read yet
+    struct OpenContainer
+    {
+        bool group = false;
+        Vec<Node *> elements = Vec<Node *>(alloc());
+        // the first size entries are read, the one after them may hold the pending key.
+        // entries past it are left over from earlier containers and keep their capacity
+        Group::Members table = Group::Members(alloc());
+        size_t size = 0;
     };
+    // the open containers, slots past depth are kept for reuse
+    struct OpenStack
+    {
+        std::vector<OpenContainer> slots;
+        size_t depth = 0;
+    };
+
+    // nodes a JSON::Context keeps between parses. recycled strings and vectors keep
+    // their capacity, so once a context has seen its documents parsing stops allocating
+    class NodePool
+    {
+    public:
+        NodePool() = default;
+        NodePool(const NodePool &) = delete;
+        ~NodePool();
+        Integer *make_integer(int64_t v, bool null);
+        Unit *make_unit(const std::string &str);
+        Bytes *make_bytes(const std::vector<unsigned char> &data);
+        Array *make_packed(const std::vector<int64_t> &vals);
+        Array *make_array(const Vec<Node *> &elements);
+        Group *make_group(Group::Members::const_iterator first, Group::Members::const_iterator last);
+        // takes back a whole tree
+        void recycle(Node *root);
+        OpenStack open;
+
+    private:
+        std::vector<Integer *> ints;
+        std::vector<Unit *> units;
+        std::vector<Bytes *> bytes;
+        // packed arrays keep their buffer, so they are kept apart from the others
+        std::vector<Array *> arrays;
+        std::vector<Array *> packed_arrays;
+        std::vector<Group *> groups;
+        std::vector<Node *> pending;
+    };
+    NodePool::~NodePool()
+    {
+        for (auto it : ints)
+            destroy(it);
+        for (auto it : units)
+            destroy(it);
+        for (auto it : bytes)
+            destroy(it);
+        for (auto it : arrays)
+            destroy(it);
+        for (auto it : groups)
+            destroy(it);
+        for (auto it : packed_arrays)
+            destroy(it);
+    }
+    Integer *NodePool::make_integer(int64_t v, bool null)
+    {
+        Integer *ret;
+        if (ints.empty())
+            ret = create<Integer>(v);
+        else
+        {
+            ret = ints.back();
+            ints.pop_back();
+            Integer::get_integer(ret) = v;
+        }
+        if (null)
+            ret->flags |= NULL_VALUE;
+        return ret;
+    }
+    Unit *NodePool::make_unit(const std::string &str)
+    {
+        if (units.empty())
+            return create<Unit>(str);
+        Unit *ret = units.back();
+        units.pop_back();
+        Unit::get_str(ret).assign(str);
+        return ret;
+    }
+    Bytes *NodePool::make_bytes(const std::vector<unsigned char> &data)
+    {
+        if (bytes.empty())
+            return create<Bytes>(data);
+        Bytes *ret = bytes.back();
+        bytes.pop_back();
+        Bytes::get_bytes(ret).assign(data.begin(), data.end());
+        return ret;
+    }
+    Array *NodePool::make_packed(const std::vector<int64_t> &vals)
+    {
+        if (packed_arrays.empty())
+            return create<Array>(std::vector<int64_t>(vals));
+        Array *ret = packed_arrays.back();
+        packed_arrays.pop_back();
+        ret->packed->assign(vals.begin(), vals.end());
+        return ret;
+    }
+    Array *NodePool::make_array(const Vec<Node *> &elements)
+    {
+        if (arrays.empty())
+            return create<Array>(elements);
+        Array *ret = arrays.back();
+        arrays.pop_back();
+        ret->elements.assign(elements.begin(), elements.end());
+        for (auto it : ret->elements)
+            it->parent = ret;
+        return ret;
+    }
+    Group *NodePool::make_group(Group::Members::const_iterator first, Group::Members::const_iterator last)
+    {
+        if (groups.empty())
+            return create<Group>(Group::Members(first, last));
+        Group *ret = groups.back();
+        groups.pop_back();
+        ret->member_table.assign(first, last);
+        ret->normalize();
+        return ret;
+    }
+    void NodePool::recycle(Node *root)
+    {
+        pending.push_back(root);
+        while (!pending.empty())
+        {
+            Node *node = pending.back();
+            pending.pop_back();
+            if (!node)
+                continue;
+            node->flags = DIRTY;
+            node->parent = nullptr;
+            switch (node->get_type())
+            {
+            case INT:
+                ints.push_back(static_cast<Integer *>(node));
+                break;
+            case STRING:
+                units.push_back(static_cast<Unit *>(node));
+                break;
+            case RAW:
+                bytes.push_back(static_cast<Bytes *>(node));
+                break;
+            case ARRAY:
+            {
+                Array *arr = static_cast<Array *>(node);
+                pending.insert(pending.end(), arr->elements.begin(), arr->elements.end());
+                arr->elements.clear();
+                delete arr->cache;
+                arr->cache = nullptr;
+                arr->hash_value = 0;
+                while (arr->index)
+                {
+                    ArrayIndex *next = arr->index->next;
+                    delete arr->index;
+                    arr->index = next;
+                }
+                (arr->packed ? packed_arrays : arrays).push_back(arr);
+                break;
+            }
+            case GROUP:
+            {
+                // the keys stay in the table, make_group assigns over them
+                Group *group = static_cast<Group *>(node);
+                for (auto &it : group->member_table)
+                {
+                    pending.push_back(it.second);
+                    it.second = nullptr;
+                }
+                delete group->cache;
+                group->cache = nullptr;
+                group->hash_value = 0;
+                groups.push_back(group);
+                break;
+            }
+            }
+        }
+    }
 
-    class Unit : public Node
+    // the raw data of a base64 data URI, decoded into the node's buffer. nullptr if
+    // the text after the prefix is not base64, the string is kept then
+    Node *decode_base64(const std::string &v)
     {
-    public:
-        Unit(const std::string &str) : Node(STRING), is_number(false), text(str) {}
-        Unit(int64_t v) : Node(INT), is_number(true), integer(v) {}
-        static int64_t &get_integer(Node *node);
-        static std::string &get_str(Node *node);
-        ~Unit() {};
+        const char *src = v.data() + BASE64_PREFIX_LEN;
+        size_t n = v.size() - BASE64_PREFIX_LEN;
+        if (n % 4)
+            return nullptr;
+        Bytes *ret = create<Bytes>(std::vector<unsigned char>());
+        Vec<unsigned char> &buf = Bytes::get_bytes(ret);
+        buf.resize(base64_decoded_size(src, n));
+        if (!base64_decode(src, n, buf.data()))
+        {
+            destroy(ret);
+            return nullptr;
+        }
+        JSON_STATS(cur_stats->nodes[JSON::RAW]++;
+                   cur_stats->bytes_allocated += sizeof(Bytes) + buf.size());
+        return ret;
+    }
 
-    private:
-        bool is_number;
-        std::string text;
-        int64_t integer;
-    };
-    class Group : public Node
+    // without a pool the buffers are moved out of the tokens.
+    // base64 turns strings marked as base64 raw data into raw data
+    Node *parse_scalar(Lexer::TokenStream &ts, NodePool *pool, bool base64)
     {
-    public:
-        Group(const std::map<std::string, Node *> &tab);
-        Node *operator[](const std::string &str) const;
-        ~Group();
-        size_t count() const;
+        switch (ts.get_cur_tag())
+        {
+        case Lexer::RAW_DATA:
+        {
+            std::vector<unsigned char> &v = Lexer::RawData::get_raw_data(ts.current());
+            ts.match(Lexer::RAW_DATA);
 
-    private:
-        friend class ::JSON;
-        std::map<std::string, Node *> member_table;
-    };
-    class Array : public Node
+            JSON_STATS(cur_stats->nodes[JSON::RAW]++;
+                       cur_stats->bytes_allocated += sizeof(Bytes) + v.size());
+            if (pool)
+                return pool->make_bytes(v);
+            return create<Bytes>(std::move(v));
+        }
+        case Lexer::INTEGER:
+        {
+            auto v = Lexer::Integer::get_content(ts.current());
+            bool null = Lexer::Integer::is_null(ts.current());
+            ts.match(Lexer::INTEGER);
+
+            JSON_STATS(cur_stats->nodes[JSON::INT]++;
+                       cur_stats->bytes_allocated += sizeof(Integer));
+            if (pool)
+                return pool->make_integer(v, null);
+            Node *ret = create<Integer>(v);
+            if (null)
+                ret->flags |= NULL_VALUE;
+            return ret;
+        }
+        case Lexer::INT_ARRAY:
+        {
+            std::vector<int64_t> &v = Lexer::IntArray::get_values(ts.current());
+            ts.match(Lexer::INT_ARRAY);
+            JSON_STATS(cur_stats->nodes[JSON::ARRAY]++;
+                       cur_stats->bytes_allocated += sizeof(Array) + sizeof(v) + v.size() * sizeof(int64_t));
+            if (pool)
+                return pool->make_packed(v);
+            return create<Array>(std::move(v));
+        }
+        case Lexer::STRING:
+        {
+            std::string &v = Lexer::StringToken::get_content(ts.current());
+            ts.match(Lexer::STRING);
+            if (base64 && !v.compare(0, BASE64_PREFIX_LEN, BASE64_PREFIX))
+            {
+                if (Node *ret = decode_base64(v))
+                    return ret;
+            }
+            JSON_STATS(cur_stats->nodes[JSON::STRING]++;
+                       cur_stats->bytes_allocated += sizeof(Unit) + v.size());
+            if (pool)
+                return pool->make_unit(v);
+            return create<Unit>(std::move(v));
+        }
+        default:
+            throw std::runtime_error(ts.current()->to_string() + " json-syntax error");
+            break;
+        }
+    }
+
+    // the key is copied into the next table entry, reusing its capacity
+    void read_key(Lexer::TokenStream &ts, OpenContainer &top)
     {
-    public:
-        Array(const std::vector<Node *> &ele);
-        Node *operator[](size_t idx) const;
-        ~Array();
-        size_t length() const;
+        auto variable_name = ts.current();
+        ts.match(Lexer::STRING);
+        ts.match(Lexer::COLON);
+        if (top.size == top.table.size())
+            top.table.emplace_back();
+        top.table[top.size].first = Lexer::StringToken::get_content(variable_name);
+    }
+    void release_open(OpenStack &stack)
+    {
+        std::vector<Node *> pending;
+        for (size_t i = 0; i < stack.depth; i++)
+        {
+            OpenContainer &top = stack.slots[i];
+            pending.insert(pending.end(), top.elements.begin(), top.elements.end());
+            top.elements.clear();
+            for (size_t k = 0; k < top.size; k++)
+                pending.push_back(top.table[k].second);
+        }
+        stack.depth = 0;
+        release(pending);
+    }
 
-    private:
-        friend class ::JSON;
-        std::vector<Node *> elements;
+    // nesting is kept on the heap, deep documents must not overflow the C++ stack.
+    // with a pool the nodes and the open containers are recycled
+    Node *parse_unit(Lexer::TokenStream &ts, NodePool *pool = nullptr, bool base64 = false)
+    {
+        static const Group::Members none;
+        OpenStack local;
+        OpenStack &stack = pool ? pool->open : local;
+        stack.depth = 0;
+        try
+        {
+            while (true)
+            {
+                Node *value = nullptr;
+                Lexer::Tag tag = ts.get_cur_tag();
+                if (tag == Lexer::LSB || tag == Lexer::BEGIN)
+                {
+                    bool group = tag == Lexer::BEGIN;
+                    Lexer::Tag close = group ? Lexer::END : Lexer::RSB;
+                    ts.match(tag);
+                    if (ts.get_cur_tag() != close)
+                    {
+                        if (stack.depth == stack.slots.size())
+                            stack.slots.emplace_back();
+                        OpenContainer &top = stack.slots[stack.depth++];
+                        top.group = group;
+                        top.size = 0;
+                        top.elements.clear();
+                        if (group)
+                            read_key(ts, top);
+                        continue;
+                    }
+                    ts.match(close);
+                    if (group)
+                    {
+                        JSON_STATS(cur_stats->nodes[JSON::GROUP]++;
+                                   cur_stats->bytes_allocated += sizeof(Group));
+                        value = pool ? pool->make_group(none.begin(), none.end()) : create<Group>(Group::Members());
+                    }
+                    else
+                    {
+                        JSON_STATS(cur_stats->nodes[JSON::ARRAY]++;
+                                   cur_stats->bytes_allocated += sizeof(Array));
+                        value = pool ? pool->make_array(Vec<Node *>()) : create<Array>(std::vector<Node *>());
+                    }
+                }
+                else
+                    value = parse_scalar(ts, pool, base64);
+
+                // attach the value, then close every container that ends here
+                while (true)
+                {
+                    if (stack.depth == 0)
+                        return value;
+                    OpenContainer &top = stack.slots[stack.depth - 1];
+                    if (top.group)
+                        top.table[top.size++].second = value;
+                    else
+                        top.elements.push_back(value);
+                    if (ts.get_cur_tag() == Lexer::COMMA)
+                    {
+                        ts.match(Lexer::COMMA);
+                        if (top.group)
+                            read_key(ts, top);
+                        break;
+                    }
+                    if (top.group)
+                    {
+                        ts.match(Lexer::END);
+                        JSON_STATS(cur_stats->nodes[JSON::GROUP]++;
+                                   cur_stats->bytes_allocated += sizeof(Group) + top.size * (sizeof(std::string) + sizeof(Node *)));
+                        if (pool)
+                            value = pool->make_group(top.table.begin(), top.table.begin() + top.size);
+                        else
+                            value = create<Group>(Group::Members(std::make_move_iterator(top.table.begin()),
+                                                                 std::make_move_iterator(top.table.begin() + top.size)));
+                        top.size = 0;
+                    }
+                    else
+                    {
+                        ts.match(Lexer::RSB);
+                        JSON_STATS(cur_stats->nodes[JSON::ARRAY]++;
+                                   cur_stats->bytes_allocated += sizeof(Array) + top.elements.size() * sizeof(Node *));
+                        value = pool ? pool->make_array(top.elements) : create<Array>(top.elements);
+                        top.elements.clear();
+                    }
+                    stack.depth--;
+                }
+            }
+        }
+        catch (...)
+        {
+            release_open(stack);
+            throw;
+        }
+    }
+}
+
+//              ===== Schema ======
+JSON::Schema::Schema(const std::string &text)
+{
+    static const std::pair<const char *, unsigned> type_names[] = {
+        {"string", T_STRING}, {"integer", T_INTEGER}, {"number", T_INTEGER}, {"boolean", T_BOOLEAN},
+        {"null", T_NULL}, {"array", T_ARRAY}, {"object", T_OBJECT}, {"raw", T_RAW}};
+    auto fail = [](const std::string &what) {
+        throw std::runtime_error("JSON::Schema: " + what);
     };
-    // extend json. (length)$raw_data$
-    class Bytes : public Node
+    auto type_of = [&](const JSON &name) {
+        if (name.get_type() == JSON::STRING)
+        {
+            for (auto &it : type_names)
+            {
+                if (name.get_str() == it.first)
+                    return it.second;
+            }
+        }
+        fail("unknown type " + name.to_string(""));
+        return 0u;
+    };
+    auto number = [&](const JSON &v, const std::string &keyword) {
+        if (v.get_type() != JSON::INT || v.is_null())
+            fail(keyword + " must be an integer");
+        return v.get_int();
+    };
+    JSON doc(text);
+    // schemas waiting to be compiled into rules[rule], the handles do not own their nodes
+    std::vector<std::pair<JSON, size_t>> pending;
+    pending.push_back({JSON(doc.node), 0});
+    rules.emplace_back();
+    while (!pending.empty())
     {
-    public:
-        Bytes(const std::vector<unsigned char> &tmp) : Node(RAW), data(tmp) {}
-        Bytes(std::vector<unsigned char> &&tmp) : Node(RAW), data(std::move(tmp)) {}
-        size_t raw_length() const
+        JSON cur = pending.back().first;
+        size_t idx = pending.back().second;
+        pending.pop_back();
+        if (cur.get_type() != JSON::GROUP)
+            fail("a schema must be an object");
+        // built aside, children are appended to rules meanwhile
+        Rule rule;
+        for (auto &kv : cur.get_map())
         {
-            return data.size();
+            const std::string &keyword = kv.first;
+            const JSON &v = kv.second;
+            if (keyword == "type")
+            {
+                if (v.get_type() == JSON::ARRAY)
+                {
+                    rule.types = 0;
+                    for (auto &name : v.get_list())
+                        rule.types |= type_of(name);
+                }
+                else
+                    rule.types = type_of(v);
+            }
+            else if (keyword == "minimum")
+                rule.minimum = number(v, keyword);
+            else if (keyword == "maximum")
+                rule.maximum = number(v, keyword);
+            else if (keyword == "minLength")
+                rule.min_length = number(v, keyword);
+            else if (keyword == "maxLength")
+                rule.max_length = number(v, keyword);
+            else if (keyword == "minItems")
+                rule.min_items = number(v, keyword);
+            else if (keyword == "maxItems")
+                rule.max_items = number(v, keyword);
+            else if (keyword == "additionalProperties")
+                rule.additional = number(v, keyword) != 0;
+            else if (keyword == "items")
+            {
+                rule.items = rules.size();
+                pending.push_back({v, rules.size()});
+                rules.emplace_back();
+            }
+            else if (keyword == "properties")
+            {
+                if (v.get_type() != JSON::GROUP)
+                    fail("properties must be an object");
+                for (auto &prop : v.get_map())
+                {
+                    rule.properties.push_back(Property{prop.first, rules.size(), ANY});
+                    pending.push_back({prop.second, rules.size()});
+                    rules.emplace_back();
+                }
+            }
+            // the map puts properties before required
+            else if (keyword == "required")
+            {
+                if (v.get_type() != JSON::ARRAY)
+                    fail("required must be an array");
+                for (auto &name : v.get_list())
+                {
+                    if (name.get_type() != JSON::STRING)
+                        fail("required must list strings");
+                    std::string key = Parser::to_std(name.get_str());
+                    auto it = std::find_if(rule.properties.begin(), rule.properties.end(),
+                                           [&](const Property &p) { return p.key == key; });
+                    if (it == rule.properties.end())
+                        it = rule.properties.insert(it, Property{key, ANY, ANY});
+                    if (it->bit == ANY)
+                        it->bit = rule.required++;
+                }
+            }
         }
-        static std::vector<unsigned char> &get_bytes(Node *node)
+        std::sort(rule.properties.begin(), rule.properties.end(),
+                  [](const Property &a, const Property &b) { return a.key < b.key; });
+        rules[idx] = std::move(rule);
+    }
+}
+
+//              ===== Projection ======
+JSON::Pointer::Pointer(const std::string &path)
+{
+    if (!path.empty() && path[0] != '/')
+        throw std::runtime_error("JSON::Pointer: " + path + " must be empty or start with /");
+    size_t pos = 0;
+    while (pos < path.size())
+    {
+        size_t next = path.find('/', pos + 1);
+        if (next == std::string::npos)
+            next = path.size();
+        Step step{std::string(), std::string::npos, 0};
+        for (size_t k = pos + 1; k < next; k++)
         {
-            return static_cast<Bytes *>(node)->data;
+            if (path[k] != '~')
+                step.key += path[k];
+            else if (k + 1 < next && (path[k + 1] == '0' || path[k + 1] == '1'))
+                step.key += path[++k] == '0' ? '~' : '/';
+            else
+                throw std::runtime_error("JSON::Pointer: invalid escape in " + path);
+        }
+        // array indices have no leading zeros
+        if (!step.key.empty() && step.key.size() < 19 && std::all_of(step.key.begin(), step.key.end(), ::isdigit) &&
+            (step.key[0] != '0' || step.key.size() == 1))
+            step.index = std::stoull(step.key);
+        steps.push_back(std::move(step));
+        pos = next;
+    }
+}
+
+JSON::Projection::Projection(const std::vector<std::string> &paths) : steps(1)
+{
+    for (auto &path : paths)
+    {
+        Pointer ptr(path);
+        size_t cur = 0;
+        for (size_t k = 0; k < ptr.size(); k++)
+        {
+            const std::string &key = ptr.key(k);
+            size_t child = 0;
+            if (key == "*")
+            {
+                if (!steps[cur].any)
+                {
+                    steps[cur].any = steps.size();
+                    steps.emplace_back();
+                }
+                child = steps[cur].any;
+            }
+            else
+            {
+                auto it = steps[cur].keys.find(key);
+                if (it == steps[cur].keys.end())
+                {
+                    it = steps[cur].keys.insert({key, steps.size()}).first;
+                    steps.emplace_back();
+                    if (ptr.index(k) != std::string::npos)
+                        steps[cur].indices[ptr.index(k)] = it->second;
+                }
+                child = it->second;
+            }
+            cur = child;
+        }
+        steps[cur].terminal = true;
+    }
+    // a key also matched by "*" takes both subtrees. children come after their parent, so
+    // the steps made by merging are reached by this loop too
+    for (size_t k = 0; k < steps.size(); k++)
+    {
+        if (!steps[k].any)
+            continue;
+        std::vector<size_t> children;
+        for (auto &it : steps[k].keys)
+            children.push_back(it.second);
+        for (auto child : children)
+            merge(child, steps[k].any);
+    }
+}
+void JSON::Projection::merge(size_t dst, size_t src)
+{
+    // indices into steps, emplace_back moves them
+    if (steps[src].terminal)
+        steps[dst].terminal = true;
+    if (steps[src].any)
+    {
+        if (!steps[dst].any)
+        {
+            steps[dst].any = steps.size();
+            steps.emplace_back();
+        }
+        merge(steps[dst].any, steps[src].any);
+    }
+    std::vector<std::pair<std::string, size_t>> keys(steps[src].keys.begin(), steps[src].keys.end());
+    for (auto &it : keys)
+    {
+        auto found = steps[dst].keys.find(it.first);
+        size_t child = found != steps[dst].keys.end() ? found->second : 0;
+        if (!child)
+        {
+            child = steps.size();
+            steps[dst].keys[it.first] = child;
+            for (auto &idx : steps[src].indices)
+            {
+                if (idx.second == it.second)
+                    steps[dst].indices[idx.first] = child;
+            }
+            steps.emplace_back();
+        }
+        merge(child, it.second);
+    }
+}
+
+namespace Parser
+{
+    // walks the text along the projection, subtrees no path leads into are skipped
+    class Projector
+    {
+    public:
+        Projector(const std::string &_str, const JSON::Projection &_proj) : str(_str), steps(_proj.steps) {}
+        Node *read_document()
+        {
+            skip_blank();
+            Node *ret = read(0);
+            if (!ret)
+                ret = create<Group>(Group::Members());
+            return ret;
         }
 
     private:
-        std::vector<unsigned char> data;
+        void skip_blank()
+        {
+            while (i < str.size() && (str[i] == ' ' || str[i] == '\t' || str[i] == '\r' || str[i] == '\n'))
+                i++;
+        }
+        void expect(char ch)
+        {
+            skip_blank();
+            if (i >= str.size() || str[i] != ch)
+                throw std::runtime_error(std::string("JSON projection: expected ") + ch + " at offset " + std::to_string(i));
+            i++;
+        }
+        // the first char of the value is at str[i]. returns nullptr if the value is not
+        // a container the remaining path can descend into. recursion is bounded by the path length
+        Node *read(size_t step)
+        {
+            const JSON::Projection::Step &cur = steps[step];
+            if (cur.terminal)
+            {
+                size_t sp = i;
+                i = Lexer::skip_value(str, i);
+                std::unique_ptr<Lexer::TokenStream> ts(Lexer::build_token_stream(str.substr(sp, i - sp)));
+                return parse_unit(*ts);
+            }
+            if (i >= str.size() || (str[i] != '{' && str[i] != '['))
+            {
+                i = Lexer::skip_value(str, i);
+                return nullptr;
+            }
+            bool group = str[i++] == '{';
+            char close = group ? '}' : ']';
+            Group::Members members;
+            std::vector<Node *> elements;
+            try
+            {
+                skip_blank();
+                if (i < str.size() && str[i] == close)
+                    i++;
+                else
+                {
+                    for (size_t idx = 0;; idx++)
+                    {
+                        skip_blank();
+                        size_t child = cur.any;
+                        if (group)
+                        {
+                            if (i >= str.size() || str[i] != '\"')
+                                throw std::runtime_error("JSON projection: expected a key at offset " + std::to_string(i));
+                            int pos = int(i);
+                            key.clear();
+                            Lexer::get_string(str, pos, key);
+                            i = pos + 1;
+                            expect(':');
+                            auto it = cur.keys.find(key);
+                            if (it != cur.keys.end())
+                                child = it->second;
+                        }
+                        else
+                        {
+                            auto it = cur.indices.find(idx);
+                            if (it != cur.indices.end())
+                                child = it->second;
+                        }
+                        skip_blank();
+                        if (child && group)
+                        {
+                            // key is reused by the nested read
+                            std::string name = key;
+                            if (Node *node = read(child))
+                                members.emplace_back(std::move(name), node);
+                        }
+                        else if (child)
+                        {
+                            if (Node *node = read(child))
+                            {
+                                // skipped elements before it read as null, so indices keep pointing at the same values
+                                while (elements.size() < idx)
+                                {
+                                    elements.push_back(create<Integer>(0));
+                                    elements.back()->flags |= NULL_VALUE;
+                                }
+                                elements.push_back(node);
+                            }
+                        }
+                        else
+                            i = Lexer::skip_value(str, i);
+                        skip_blank();
+                        if (i < str.size() && str[i] == ',')
+                        {
+                            i++;
+                            continue;
+                        }
+                        expect(close);
+                        break;
+                    }
+                }
+            }
+            catch (...)
+            {
+                for (auto &it : members)
+                    elements.push_back(it.second);
+                release(elements);
+                throw;
+            }
+            if (group)
+                return create<Group>(std::move(members));
+            return create<Array>(std::move(elements));
+        }
+
+        const std::string &str;
+        const std::vector<JSON::Projection::Step> &steps;
+        size_t i = 0;
+        std::string key;
     };
 }
 
-namespace Parser
+//              ===== JSONBind ======
+namespace JSONBind
 {
-    int64_t &Node::get_int()
+    void Reader::fail(const char *what)
     {
-        if (type == INT)
+        throw std::runtime_error(std::string("JSONBind: ") + what + " at offset " + std::to_string(i));
+    }
+    void Reader::skip_blank()
+    {
+        while (i < str.size() && (str[i] == ' ' || str[i] == '\t' || str[i] == '\r' || str[i] == '\n'))
+            i++;
+    }
+    void Reader::expect(char ch)
+    {
+        skip_blank();
+        if (i >= str.size() || str[i] != ch)
         {
-            return Unit::get_integer(this);
+            char what[] = "expected ' '";
+            what[10] = ch;
+            fail(what);
         }
-        else
-            throw std::runtime_error("type not matched");
+        i++;
     }
-    std::vector<unsigned char> &Node::get_raw()
+    void Reader::read_int(int64_t &v, uint64_t max)
     {
-        if (type == RAW)
+        skip_blank();
+        if (i < str.size() && isalpha(str[i]))
         {
-            return Bytes::get_bytes(this);
+            size_t sp = i;
+            while (i < str.size() && isalpha(str[i]))
+                i++;
+            if (!str.compare(sp, i - sp, "true"))
+                v = 1;
+            else if (!str.compare(sp, i - sp, "false") || !str.compare(sp, i - sp, "null"))
+                v = 0;
+            else
+            {
+                i = sp;
+                fail("expected an integer");
+            }
+            return;
         }
-        else
+        // the tree parser has no negative numbers, the binder keeps to the same text
+        if (i < str.size() && str[i] == '-')
+            fail("negative integers are not supported");
+        if (i >= str.size() || !isdigit(str[i]))
+            fail("expected an integer");
+        size_t sp = i;
+        uint64_t u = 0;
+        while (i < str.size() && isdigit(str[i]))
         {
-            throw std::runtime_error("type not matched excepted a bytes");
+            u = u * 10 + (str[i] - '0');
+            if (u > max)
+            {
+                i = sp;
+                fail("integer out of range");
+            }
+            i++;
         }
+        v = int64_t(u);
     }
-    std::string &Node::get_str()
+    void Reader::read_string(std::string &v)
     {
-        if (type == STRING)
+        skip_blank();
+        if (i >= str.size() || str[i] != '\"')
+            fail("expected a string");
+        // no escapes, copy the bytes as they are
+        size_t end = i + 1;
+        while (end < str.size() && str[end] != '\"' && str[end] != '\\')
+            end++;
+        if (end < str.size() && str[end] == '\"')
         {
-            return Unit::get_str(this);
+            v.assign(str, i + 1, end - i - 1);
+            i = end + 1;
+            return;
+        }
+        v.clear();
+        int pos = int(i);
+        Lexer::get_string(str, pos, v);
+        if (size_t(pos) >= str.size())
+            fail("unterminated string");
+        i = pos + 1;
+    }
+    void Reader::read_raw(std::vector<unsigned char> &v)
+    {
+        skip_blank();
+        if (i >= str.size() || str[i] != '(')
+            fail("expected raw data");
+        size_t sp = i;
+        i = Lexer::skip_raw(str, i);
+        size_t content = str.find(')', sp) + 2;
+        v.assign(str.begin() + content, str.begin() + (i - 1));
+    }
+    void Reader::object_begin()
+    {
+        expect('{');
+        first = true;
+    }
+    bool Reader::next_key(const char *&key, size_t &len)
+    {
+        skip_blank();
+        if (i < str.size() && str[i] == '}' )
+        {
+            i++;
+            first = false;
+            return false;
+        }
+        if (!first)
+        {
+            expect(',');
+            skip_blank();
+        }
+        first = false;
+        if (i >= str.size() || str[i] != '\"')
+            fail("expected a key");
+        size_t end = i + 1;
+        while (end < str.size() && str[end] != '\"' && str[end] != '\\')
+            end++;
+        if (end < str.size() && str[end] == '\"')
+        {
+            key = str.data() + i + 1;
+            len = end - i - 1;
+            i = end + 1;
         }
         else
-            throw std::runtime_error("type not matched");
+        {
+            key_buf.clear();
+            int pos = int(i);
+            Lexer::get_string(str, pos, key_buf);
+            if (size_t(pos) >= str.size())
+                fail("unterminated string");
+            i = pos + 1;
+            key = key_buf.data();
+            len = key_buf.size();
+        }
+        expect(':');
+        return true;
+    }
+    void Reader::array_begin()
+    {
+        expect('[');
+        first = true;
+    }
+    bool Reader::next_element()
+    {
+        skip_blank();
+        if (i < str.size() && str[i] == ']')
+        {
+            i++;
+            first = false;
+            return false;
+        }
+        if (!first)
+            expect(',');
+        first = false;
+        return true;
+    }
+    void Reader::skip()
+    {
+        skip_blank();
+        i = Lexer::skip_value(str, i);
+    }
+    char Reader::peek()
+    {
+        skip_blank();
+        return i < str.size() ? str[i] : 0;
     }
-    Node *Node::operator[](const std::string &str)
+    bool Reader::read_null()
     {
-        if (type != GROUP)
-        {
-            throw std::runtime_error("type not matched, expected an array!");
-        }
-        return static_cast<Group *>(this)->operator[](str);
+        skip_blank();
+        if (str.compare(i, 4, "null") || (i + 4 < str.size() && isalpha(str[i + 4])))
+            return false;
+        i += 4;
+        return true;
     }
-    Node *Node::operator[](size_t idx)
+    void Reader::finish()
     {
-        if (type != ARRAY)
-            throw std::runtime_error("type not matched, expected an array!");
-        return static_cast<Array *>(this)->operator[](idx);
+        skip_blank();
+        if (i < str.size())
+            fail("unexpected characters after the value");
     }
-    Node::~Node() {}
-    // Unit
-    int64_t &Unit::get_integer(Node *node)
+
+    void Writer::write_int(int64_t v)
     {
-        return static_cast<Unit *>(node)->integer;
+        if (v < 0)
+            throw std::runtime_error("JSONBind: negative integers are not supported");
+        append_int(out, v);
     }
-    std::string &Unit::get_str(Node *node)
+    void Writer::write_string(const std::string &v)
     {
-        return static_cast<Unit *>(node)->text;
+        out += '\"';
+        out += conv_str(v);
+        out += '\"';
     }
-    // Array
-    Array::Array(const std::vector<Node *> &ele) : Node(ARRAY), elements(ele) {}
-    Node *Array::operator[](size_t idx) const
+    void Writer::write_raw(const std::vector<unsigned char> &v)
     {
-        if (idx >= elements.size())
-            throw std::runtime_error("Array out of range!");
-        return elements[idx];
+        out += '(';
+        append_int(out, int64_t(v.size()));
+        out += ")$";
+        out.append(v.begin(), v.end());
+        out += '$';
     }
-    Array::~Array()
+    void Writer::key(const char *name, size_t len)
     {
-        for (auto e : elements)
-            delete e;
+        if (out.back() != '{')
+            out += ',';
+        out += '\"';
+        out.append(name, len);
+        out += "\":";
     }
-    size_t Array::length() const
+}
+
+//              ===== Columns ======
+namespace
+{
+    void push_bit(std::vector<uint64_t> &bits, size_t row, bool on)
     {
-        return elements.size();
+        if (row % 64 == 0)
+            bits.push_back(0);
+        bits.back() |= uint64_t(on) << (row % 64);
     }
-    // Group
-    Group::Group(const std::map<std::string, Node *> &tab) : Node(GROUP), member_table(tab) {}
-    Node *Group::operator[](const std::string &str) const
+    // every value goes through here, so the vectors of a column always agree on the row count
+    void push_row(JSON::Column &col, bool missing, bool null)
     {
-        auto it = member_table.find(str);
-        if (it == member_table.end())
+        push_bit(col.missing, col.rows, missing);
+        push_bit(col.nulls, col.rows, null);
+        if (col.type == JSON::INT)
         {
-            throw std::runtime_error("key " + str + " not found");
+            if (missing || null)
+                col.ints.push_back(0);
         }
-        return it->second;
+        else
+            col.offsets.push_back(col.data.size());
+        col.rows++;
     }
-    Group::~Group()
+    void check_columns(const std::vector<JSON::Column> &cols)
     {
-        for (auto it : member_table)
-            delete it.second;
+        for (auto &col : cols)
+        {
+            if (col.type != JSON::INT && col.type != JSON::STRING && col.type != JSON::RAW)
+                throw std::runtime_error("JSON::Column " + col.name + ": the type must be INT, STRING or RAW");
+        }
     }
-    size_t Group::count() const
+    void push_node(JSON::Column &col, Parser::Node *v)
     {
-        return member_table.size();
+        if (!v)
+            return push_row(col, true, false);
+        if (v->is_null())
+            return push_row(col, false, true);
+        if (v->get_type() != Parser::NodeType(col.type))
+            return push_row(col, true, false);
+        if (col.type == JSON::INT)
+            col.ints.push_back(v->get_int());
+        else if (col.type == JSON::STRING)
+            col.data += v->get_str();
+        else
+            col.data.append(v->get_raw().begin(), v->get_raw().end());
+        push_row(col, false, false);
     }
-
-    Node *parse_unit(Lexer::TokenStream &token_stream);
-    Array *parse_array(Lexer::TokenStream &ts)
+    // reads the value of a matched key, values of another type are skipped
+    void push_text(JSON::Column &col, JSONBind::Reader &r, std::string &str_buf, std::vector<unsigned char> &raw_buf)
     {
-        ts.match(Lexer::LSB);
-        if (ts.get_cur_tag() == Lexer::RSB)
+        if (r.read_null())
+            return push_row(col, false, true);
+        char ch = r.peek();
+        if (col.type == JSON::INT && (isdigit(ch) || ch == '-' || isalpha(ch)))
         {
-            ts.match(Lexer::RSB);
-            return new Array({});
+            int64_t v;
+            r.read_int(v);
+            col.ints.push_back(v);
         }
-        std::vector<Node *> vec;
-        while (true)
+        else if (col.type == JSON::STRING && ch == '\"')
         {
-            vec.push_back(parse_unit(ts));
-            if (ts.get_cur_tag() != Lexer::COMMA)
-                break;
-            ts.match(Lexer::COMMA);
+            r.read_string(str_buf);
+            col.data += str_buf;
+        }
+        else if (col.type == JSON::RAW && ch == '(')
+        {
+            r.read_raw(raw_buf);
+            col.data.append(raw_buf.begin(), raw_buf.end());
+        }
+        else
+        {
+            r.skip();
+            return push_row(col, true, false);
         }
-        ts.match(Lexer::RSB);
-        return new Array(vec);
+        push_row(col, false, false);
+    }
+}
+void JSON::Column::clear()
+{
+    rows = 0;
+    ints.clear();
+    data.clear();
+    offsets.assign(1, 0);
+    nulls.clear();
+    missing.clear();
+}
+void JSON::get_columns(std::vector<Column> &cols) const
+{
+    if (node->get_type() != Parser::ARRAY)
+        throw std::runtime_error("JSON::get_columns(): expected an array");
+    check_columns(cols);
+    auto arr = static_cast<Parser::Array *>(node);
+    // a packed array holds no objects, every row is missing
+    size_t rows = arr->length();
+    std::vector<size_t> hints(cols.size(), 0);
+    for (size_t k = 0; k < rows; k++)
+    {
+        Parser::Node *row = arr->packed ? nullptr : arr->elements[k];
+        auto group = row && row->get_type() == Parser::GROUP ? static_cast<Parser::Group *>(row) : nullptr;
+        for (size_t c = 0; c < cols.size(); c++)
+            push_node(cols[c], group ? group->find(cols[c].name, hints[c]) : nullptr);
     }
-    Group *parse_group(Lexer::TokenStream &ts)
+}
+void JSON::read_columns(const std::string &str, std::vector<Column> &cols)
+{
+    check_columns(cols);
+    JSONBind::Reader r(str);
+    std::string str_buf;
+    std::vector<unsigned char> raw_buf;
+    // the columns already filled in the current row, duplicated keys keep the first value
+    std::vector<char> filled(cols.size());
+    // the column after the last matched one, records usually keep their key order
+    size_t next = 0;
+    r.array_begin();
+    while (r.next_element())
     {
-        ts.match(Lexer::BEGIN);
-        if (ts.get_cur_tag() == Lexer::END)
+        std::fill(filled.begin(), filled.end(), 0);
+        if (r.peek() != '{')
+            r.skip();
+        else
         {
-            ts.match(Lexer::END);
-            return new Group({});
+            const char *key;
+            size_t len;
+            r.object_begin();
+            while (r.next_key(key, len))
+            {
+                size_t c = 0;
+                for (; c < cols.size(); c++)
+                {
+                    const std::string &name = cols[(next + c) % cols.size()].name;
+                    if (name.size() == len && memcmp(name.data(), key, len) == 0)
+                        break;
+                }
+                if (c == cols.size() || filled[(next + c) % cols.size()])
+                {
+                    r.skip();
+                    continue;
+                }
+                c = (next + c) % cols.size();
+                push_text(cols[c], r, str_buf, raw_buf);
+                filled[c] = 1;
+                next = c + 1;
+            }
         }
-        std::map<std::string, Node *> table;
-        while (true)
+        for (size_t c = 0; c < cols.size(); c++)
         {
-            auto variable_name = ts.current();
-            ts.match(Lexer::STRING);
-            ts.match(Lexer::COLON);
-            table.insert({Lexer::StringToken::get_content(variable_name), parse_unit(ts)});
-            if (ts.get_cur_tag() != Lexer::COMMA)
-                break;
-            ts.match(Lexer::COMMA);
+            if (!filled[c])
+                push_row(cols[c], true, false);
         }
-        ts.match(Lexer::END);
-        return new Group(table);
     }
-    Node *parse_unit(Lexer::TokenStream &ts)
+    r.finish();
+}
+
+//              ===== Indexes ======
+namespace
+{
+    Parser::Array *as_array(Parser::Node *node, const char *what)
+    {
+        if (node->get_type() != Parser::ARRAY)
+            throw std::runtime_error(std::string("JSON::") + what + "(): expected an array");
+        return static_cast<Parser::Array *>(node);
+    }
+    // the element whose value at field hashes to h and passes match, nullptr if none
+    template <typename Match>
+    Parser::Node *index_lookup(Parser::Node *node, const std::string &field, uint64_t h, Match match)
     {
-        switch (ts.get_cur_tag())
+        Parser::Array *arr = as_array(node, "find_by");
+        Parser::ArrayIndex *idx = arr->get_index(field);
+        arr->refresh(idx);
+        auto range = idx->keys.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it)
         {
-        case Lexer::RAW_DATA:
-        {
-            std::vector<unsigned char> &&v = Lexer::RawData::get_raw_data(ts.current());
-            ts.match(Lexer::RAW_DATA);
+            // equal hashes only make a candidate
+            if (match(Parser::index_field(idx, it->second)))
+                return it->second;
+        }
+        return nullptr;
+    }
+}
+void JSON::create_index(const std::string &field) const
+{
+    as_array(node, "create_index")->get_index(field);
+}
+bool JSON::drop_index(const std::string &field) const
+{
+    return as_array(node, "drop_index")->drop_index(field);
+}
+bool JSON::find_by(const std::string &field, const std::string &key, JSON &out) const
+{
+    Parser::Node *elem = index_lookup(node, field, hash_bytes(key.data(), key.size(), Parser::STRING),
+                                      [&](Parser::Node *value) {
+                                          return value->get_type() == Parser::STRING &&
+                                                 !Parser::key_compare(Parser::Unit::get_str(value), key);
+                                      });
+    if (!elem)
+        return false;
+    if (!out.child)
+        Parser::release(out.node);
+    out.node = elem;
+    out.child = true;
+    return true;
+}
+bool JSON::find_by(const std::string &field, int64_t key, JSON &out) const
+{
+    Parser::Node *elem = index_lookup(node, field, Parser::hash_int(key, false), [&](Parser::Node *value) {
+        return value->get_type() == Parser::INT && !value->is_null() && Parser::Integer::get_integer(value) == key;
+    });
+    if (!elem)
+        return false;
+    if (!out.child)
+        Parser::release(out.node);
+    out.node = elem;
+    out.child = true;
+    return true;
+}
+void JSON::build_indexes(const ParseOptions &opts) const
+{
+    for (auto &it : opts.indexes)
+    {
+        Pointer ptr(it.first);
+        Parser::Node *arr = locate(ptr, ptr.size());
+        if (arr && arr->get_type() == Parser::ARRAY)
+            static_cast<Parser::Array *>(arr)->get_index(it.second);
+    }
+}
+
+//              ===== Streams ======
+namespace
+{
+    // the unit of reads and writes, also what the writer lets its text grow to
+    const size_t STREAM_CHUNK = 1 << 16;
 
-            return (Node *)(new Bytes(std::move(v)));
+    // reads text from a stream, gzip input is inflated on the way
+    class Source
+    {
+    public:
+        // the magic bytes are taken from the first chunk
+        Source(std::istream &_in) : in(_in), buf(STREAM_CHUNK)
+        {
+            fill();
+            if (avail >= 2 && (unsigned char)buf[0] == 0x1f && (unsigned char)buf[1] == 0x8b)
+            {
+#ifdef JSON_LITE_ZLIB
+                memset(&zs, 0, sizeof(zs));
+                if (inflateInit2(&zs, 15 + 16) != Z_OK)
+                    throw std::runtime_error("JSON::read_from: inflateInit2 failed");
+                gzip = true;
+                zs.next_in = reinterpret_cast<Bytef *>(buf.data());
+                zs.avail_in = uInt(avail);
+#else
+                throw std::runtime_error("JSON::read_from: gzip input needs JSON_LITE_ZLIB");
+#endif
+            }
+            else if (avail >= 4 && memcmp(buf.data(), "\x28\xb5\x2f\xfd", 4) == 0)
+                throw std::runtime_error("JSON::read_from: zstd input is not supported");
         }
-        case Lexer::INTEGER:
+        Source(const Source &) = delete;
+        ~Source()
         {
-            auto v = Lexer::Integer::get_content(ts.current());
-            ts.match(Lexer::INTEGER);
-
-            return (Node *)(new Unit(v));
+#ifdef JSON_LITE_ZLIB
+            if (gzip)
+                inflateEnd(&zs);
+#endif
         }
-        case Lexer::STRING:
+        // appends up to n bytes to out, false once the input is used up
+        bool read(std::string &out, size_t n)
         {
-            auto front_part = ts.current();
-            ts.match(Lexer::STRING);
-            return (Node *)(new Unit(Lexer::StringToken::get_content(front_part)));
+#ifdef JSON_LITE_ZLIB
+            if (gzip)
+                return inflate_to(out, n);
+#endif
+            size_t start = out.size();
+            while (out.size() - start < n)
+            {
+                if (pos == avail && !fill())
+                    return false;
+                size_t take = std::min(avail - pos, n - (out.size() - start));
+                out.append(buf.data() + pos, take);
+                pos += take;
+            }
+            return true;
         }
-        case Lexer::LSB:
+
+    private:
+        // false at the end of the input
+        bool fill()
         {
-            return (Node *)(parse_array(ts));
+            in.read(buf.data(), buf.size());
+            if (in.bad())
+                throw std::runtime_error("JSON::read_from: read failed");
+            avail = size_t(in.gcount());
+            pos = 0;
+            return avail != 0;
         }
-        case Lexer::BEGIN:
+#ifdef JSON_LITE_ZLIB
+        bool inflate_to(std::string &out, size_t n)
         {
-            return (Node *)(parse_group(ts));
+            size_t start = out.size();
+            out.resize(start + n);
+            zs.next_out = reinterpret_cast<Bytef *>(&out[start]);
+            zs.avail_out = uInt(n);
+            bool more = true;
+            while (zs.avail_out && more)
+            {
+                if (!zs.avail_in)
+                {
+                    if (!fill())
+                        throw std::runtime_error("JSON::read_from: truncated gzip input");
+                    zs.next_in = reinterpret_cast<Bytef *>(buf.data());
+                    zs.avail_in = uInt(avail);
+                }
+                int ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END)
+                {
+                    // concatenated gzip members continue the text
+                    if (!zs.avail_in && fill())
+                    {
+                        zs.next_in = reinterpret_cast<Bytef *>(buf.data());
+                        zs.avail_in = uInt(avail);
+                    }
+                    if (zs.avail_in)
+                        inflateReset(&zs);
+                    else
+                        more = false;
+                }
+                else if (ret != Z_OK && ret != Z_BUF_ERROR)
+                    throw std::runtime_error("JSON::read_from: corrupt gzip input");
+            }
+            out.resize(start + n - zs.avail_out);
+            return more;
         }
-        default:
-            throw std::runtime_error(ts.current()->to_string() + " json-syntax error");
-            break;
+        z_stream zs;
+#endif
+        std::istream &in;
+        std::vector<char> buf;
+        size_t pos = 0;
+        size_t avail = 0;
+        bool gzip = false;
+    };
+}
+// writes text to a stream, deflating it on the way for GZIP
+struct JSON::Sink
+{
+    Sink(std::ostream &_out, Compression comp) : out(_out), gzip(comp == GZIP)
+    {
+        if (!gzip)
+            return;
+#ifdef JSON_LITE_ZLIB
+        memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("JSON::write_to: deflateInit2 failed");
+        buf.resize(STREAM_CHUNK);
+#else
+        throw std::runtime_error("JSON::write_to: gzip output needs JSON_LITE_ZLIB");
+#endif
+    }
+    Sink(const Sink &) = delete;
+    ~Sink()
+    {
+#ifdef JSON_LITE_ZLIB
+        if (gzip)
+            deflateEnd(&zs);
+#endif
+    }
+    // takes the text and clears it
+    void write(std::string &text)
+    {
+        bytes += text.size();
+#ifdef JSON_LITE_ZLIB
+        if (gzip)
+        {
+            zs.next_in = reinterpret_cast<Bytef *>(&text[0]);
+            zs.avail_in = uInt(text.size());
+            deflate_all(Z_NO_FLUSH);
         }
+        else
+#endif
+            out.write(text.data(), text.size());
+        text.clear();
+        if (!out)
+            throw std::runtime_error("JSON::write_to: write failed");
     }
-}
+    // ends the compressed stream
+    void finish()
+    {
+#ifdef JSON_LITE_ZLIB
+        if (gzip)
+            deflate_all(Z_FINISH);
+#endif
+        out.flush();
+        if (!out)
+            throw std::runtime_error("JSON::write_to: write failed");
+    }
+#ifdef JSON_LITE_ZLIB
+    // runs deflate until it takes no more input, or until the stream ends for Z_FINISH
+    void deflate_all(int flush)
+    {
+        while (true)
+        {
+            zs.next_out = reinterpret_cast<Bytef *>(buf.data());
+            zs.avail_out = uInt(buf.size());
+            int ret = deflate(&zs, flush);
+            out.write(buf.data(), buf.size() - zs.avail_out);
+            if (ret == Z_STREAM_END || (flush == Z_NO_FLUSH && zs.avail_out))
+                return;
+            if (ret != Z_OK && ret != Z_BUF_ERROR)
+                throw std::runtime_error("JSON::write_to: deflate failed");
+        }
+    }
+    z_stream zs;
+    std::vector<char> buf;
+#endif
+    std::ostream &out;
+    bool gzip;
+    // uncompressed bytes written
+    size_t bytes = 0;
+};
 
 //              ===== JSON implementation ======
+namespace
+{
+    Parser::Node *parse_text(const std::string &str, bool base64)
+    {
+        JSON_STATS_BEGIN("parse", str.size());
+        std::unique_ptr<Lexer::TokenStream> ts(Lexer::build_token_stream(str));
+        JSON_STATS_LAP(SCAN);
+        Parser::Node *node = Parser::parse_unit(*ts, nullptr, base64);
+        JSON_STATS_LAP(BUILD);
+
+        ts.reset();
+        JSON_STATS_LAP(TEARDOWN);
+        JSON_STATS_END();
+        return node;
+    }
+}
 // constructor
 JSON::JSON() : JSON("{}")
 {
 }
-JSON::JSON(const std::string &str) : child(false)
+JSON::JSON(const std::string &str) : child(false), node(parse_text(str, false))
 {
-    auto ts = Lexer::build_token_stream(str);
-    node = Parser::parse_unit(*ts);
-
-    delete ts;
+}
+JSON::JSON(const std::string &str, const ParseOptions &opts) : child(false), node(nullptr)
+{
+    Error err;
+    if (!validate(str, opts, err))
+        throw std::runtime_error(std::string("JSON: ") + error_message(err.code) + " at line " +
+                                 std::to_string(err.line) + ", column " + std::to_string(err.column));
+    node = parse_text(str, opts.decode_base64);
+    build_indexes(opts);
+}
+JSON::JSON(const std::string &str, const Projection &proj) : child(false)
+{
+    JSON_STATS_BEGIN("parse", str.size());
+    node = Parser::Projector(str, proj).read_document();
+    JSON_STATS_LAP(BUILD);
+    JSON_STATS_END();
 }
 JSON::JSON(Parser::Node *n) : child(true), node(n) {}
 JSON::JSON(const JSON &rhs) : child(rhs.child), node(rhs.node)
@@ -755,16 +4220,20 @@ JSON::JSONTYPE JSON::get_type() const
 {
     return (JSONTYPE)node->get_type();
 }
+// the mutable references may be written through, the node counts as changed
 int64_t &JSON::get_int() const
 {
+    node->touch();
     return node->get_int();
 }
-std::string &JSON::get_str() const
+JSON::String &JSON::get_str() const
 {
+    node->touch();
     return node->get_str();
 }
-std::vector<unsigned char> &JSON::get_raw() const
+JSON::RawData &JSON::get_raw() const
 {
+    node->touch();
     return node->get_raw();
 }
 std::map<std::string, JSON> JSON::get_map() const
@@ -773,9 +4242,9 @@ std::map<std::string, JSON> JSON::get_map() const
         throw std::runtime_error("JSON::get_keys(): expected a GROUP");
     std::map<std::string, JSON> ret;
     auto &tmp = static_cast<Parser::Group *>(node)->member_table;
-    for (auto val : tmp)
+    for (auto &val : tmp)
     {
-        ret.insert({val.first, JSON(val.second)});
+        ret.emplace_hint(ret.end(), val.first, JSON(val.second));
     }
     return ret;
 }
@@ -783,6 +4252,7 @@ std::vector<JSON> JSON::get_list() const
 {
     if (node->get_type() != Parser::ARRAY)
         throw std::runtime_error("JSON::get_list(): expected an array");
+    static_cast<Parser::Array *>(node)->unpack();
     auto &tmp = static_cast<Parser::Array *>(node)->elements;
     std::vector<JSON> ret;
     for (auto val : tmp)
@@ -800,22 +4270,444 @@ JSON JSON::operator[](size_t idx)
 {
     return JSON(node->operator[](idx));
 }
-
-void JSON::add_pair(const std::string &str, JSON json)
+
+Parser::Node *JSON::locate(const Pointer &ptr, size_t count) const
+{
+    Parser::Node *cur = node;
+    for (size_t k = 0; k < count; k++)
+    {
+        auto &step = ptr.steps[k];
+        if (cur->get_type() == Parser::GROUP)
+            cur = static_cast<Parser::Group *>(cur)->find(step.key, step.slot_hint);
+        else if (cur->get_type() == Parser::ARRAY && step.index < static_cast<Parser::Array *>(cur)->length())
+            cur = static_cast<Parser::Array *>(cur)->operator[](step.index);
+        else
+            return nullptr;
+        if (!cur)
+            return nullptr;
+    }
+    return cur;
+}
+Parser::Node *JSON::unlink(const Pointer &ptr)
+{
+    if (!ptr.size())
+        return nullptr;
+    size_t last = ptr.size() - 1;
+    Parser::Node *parent = locate(ptr, last);
+    if (parent && parent->get_type() == Parser::GROUP)
+        return static_cast<Parser::Group *>(parent)->detach(ptr.key(last));
+    if (parent && parent->get_type() == Parser::ARRAY && ptr.index(last) < static_cast<Parser::Array *>(parent)->length())
+        return static_cast<Parser::Array *>(parent)->detach(ptr.index(last));
+    return nullptr;
+}
+
+bool JSON::find(const Pointer &ptr, JSON &out) const
+{
+    Parser::Node *cur = locate(ptr, ptr.size());
+    if (!cur)
+        return false;
+    if (!out.child)
+        Parser::release(out.node);
+    out.node = cur;
+    out.child = true;
+    return true;
+}
+bool JSON::find(const Pointer &ptr, View &out) const
+{
+    return View(node).find(ptr, out);
+}
+JSON JSON::at(const Pointer &ptr) const
+{
+    JSON ret(true, nullptr);
+    if (!find(ptr, ret))
+        throw std::runtime_error("JSON::at(): path not found");
+    return ret;
+}
+
+void JSON::add_pair(const std::string &str, JSON json)
+{
+    json.child = true;
+    if (get_type() != JSON::GROUP)
+        throw std::runtime_error("JSON::add_pair type not matched expected a map");
+
+    // an existing key keeps its value
+    if (!static_cast<Parser::Group *>(node)->insert(str, json.node))
+        Parser::release(json.node);
+}
+void JSON::push(JSON json)
+{
+    json.child = true;
+    if (get_type() != JSON::ARRAY)
+        throw std::runtime_error("JSON::push type not matched expected an array");
+
+    auto arr = static_cast<Parser::Array *>(node);
+    arr->insert(arr->length(), json.node);
+}
+
+void JSON::set(const std::string &str, JSON json)
+{
+    if (get_type() != JSON::GROUP)
+        throw std::runtime_error("JSON::set type not matched expected a map");
+    json.child = true;
+    Parser::release(static_cast<Parser::Group *>(node)->replace(str, json.node));
+}
+bool JSON::erase(const std::string &str)
+{
+    if (get_type() != JSON::GROUP)
+        throw std::runtime_error("JSON::erase type not matched expected a map");
+    Parser::Node *old = static_cast<Parser::Group *>(node)->detach(str);
+    Parser::release(old);
+    return old != nullptr;
+}
+void JSON::insert(size_t idx, JSON json)
+{
+    if (get_type() != JSON::ARRAY)
+        throw std::runtime_error("JSON::insert type not matched expected an array");
+    static_cast<Parser::Array *>(node)->insert(idx, json.node);
+    json.child = true;
+}
+void JSON::set(size_t idx, JSON json)
+{
+    if (get_type() != JSON::ARRAY)
+        throw std::runtime_error("JSON::set type not matched expected an array");
+    Parser::Node *old = static_cast<Parser::Array *>(node)->replace(idx, json.node);
+    json.child = true;
+    Parser::release(old);
+}
+void JSON::erase(size_t idx)
+{
+    if (get_type() != JSON::ARRAY)
+        throw std::runtime_error("JSON::erase type not matched expected an array");
+    Parser::release(static_cast<Parser::Array *>(node)->detach(idx));
+}
+JSON JSON::detach(const Pointer &ptr)
+{
+    Parser::Node *ret = unlink(ptr);
+    if (!ret)
+        throw std::runtime_error("JSON::detach(): path not found");
+    return JSON(false, ret);
+}
+
+void JSON::apply_patch(const JSON &patch)
+{
+    // values are moved out of the patch, so a copy is taken apart instead
+    apply_patch(JSON(patch.stringify_unit("", 0, RAW_INLINE)));
+}
+void JSON::apply_patch(JSON &&patch)
+{
+    // a child handle belongs to another document
+    if (patch.child)
+        return apply_patch(static_cast<const JSON &>(patch));
+    if (patch.get_type() != JSON::ARRAY)
+        throw std::runtime_error("JSON::apply_patch(): expected an array of operations");
+    // links value at ptr. array indices are inserted before unless overwrite is set,
+    // which also requires the target to exist
+    auto link = [this](const Pointer &ptr, JSON &value, bool overwrite) {
+        if (!ptr.size())
+        {
+            if (child)
+                return false;
+            Parser::release(node);
+            node = value.node;
+            value.child = true;
+            return true;
+        }
+        size_t last = ptr.size() - 1;
+        Parser::Node *parent = locate(ptr, last);
+        if (parent && parent->get_type() == Parser::GROUP)
+        {
+            auto group = static_cast<Parser::Group *>(parent);
+            if (overwrite && !group->find(ptr.key(last)))
+                return false;
+            value.child = true;
+            Parser::release(group->replace(ptr.key(last), value.node));
+            return true;
+        }
+        if (parent && parent->get_type() == Parser::ARRAY)
+        {
+            auto arr = static_cast<Parser::Array *>(parent);
+            size_t idx = !overwrite && ptr.key(last) == "-" ? arr->length() : ptr.index(last);
+            if (idx > arr->length() || (overwrite && idx == arr->length()))
+                return false;
+            value.child = true;
+            if (overwrite)
+                Parser::release(arr->replace(idx, value.node, true));
+            else
+                arr->insert(idx, value.node);
+            return true;
+        }
+        return false;
+    };
+    auto member = [](Parser::Group *group, const char *name) -> const Parser::Text & {
+        Parser::Node *ret = group->find(name);
+        if (!ret || ret->get_type() != Parser::STRING)
+            throw std::runtime_error(std::string("JSON::apply_patch(): expected a string member ") + name);
+        return ret->get_str();
+    };
+
+    for (auto &item : patch.get_list())
+    {
+        if (item.get_type() != JSON::GROUP)
+            throw std::runtime_error("JSON::apply_patch(): every operation must be an object");
+        auto group = static_cast<Parser::Group *>(item.node);
+        const std::string &op = Parser::to_std(member(group, "op"));
+        const std::string &path = Parser::to_std(member(group, "path"));
+        Pointer ptr(path);
+        JSON value(true, nullptr);
+        bool overwrite = false;
+        // where a moved value came from, it goes back there if it cannot be linked
+        std::string source;
+        if (op == "add" || op == "replace")
+        {
+            Parser::Node *v = group->detach("value");
+            if (!v)
+                throw std::runtime_error("JSON::apply_patch(): " + op + " needs a value");
+            value = JSON(false, v);
+            overwrite = op == "replace";
+        }
+        else if (op == "remove")
+        {
+            Parser::Node *old = unlink(ptr);
+            if (!old)
+                throw std::runtime_error("JSON::apply_patch(): path " + path + " not found");
+            Parser::release(old);
+            continue;
+        }
+        else if (op == "move")
+        {
+            const std::string &from = Parser::to_std(member(group, "from"));
+            if (path.compare(0, from.size() + 1, from + "/") == 0)
+                throw std::runtime_error("JSON::apply_patch(): cannot move " + from + " into itself");
+            Parser::Node *v = unlink(Pointer(from));
+            if (!v)
+                throw std::runtime_error("JSON::apply_patch(): path " + from + " not found");
+            value = JSON(false, v);
+            source = from;
+        }
+        else if (op == "copy")
+        {
+            // read through views, a packed source stays packed
+            const std::string &from = Parser::to_std(member(group, "from"));
+            View v;
+            if (!find(Pointer(from), v))
+                throw std::runtime_error("JSON::apply_patch(): path " + from + " not found");
+            value = v.clone();
+        }
+        else if (op == "test")
+        {
+            View cur;
+            Parser::Node *expected = group->find("value");
+            if (!find(ptr, cur) || !expected || cur != View(expected))
+                throw std::runtime_error("JSON::apply_patch(): test failed at " + path);
+            continue;
+        }
+        else
+            throw std::runtime_error("JSON::apply_patch(): unknown operation " + op);
+        if (!link(ptr, value, overwrite))
+        {
+            if (!source.empty())
+                link(Pointer(source), value, false);
+            throw std::runtime_error("JSON::apply_patch(): cannot " + op + " at " + path);
+        }
+    }
+}
+
+void JSON::merge_patch(const JSON &patch)
+{
+    merge_patch(JSON(patch.stringify_unit("", 0, RAW_INLINE)));
+}
+void JSON::merge_patch(JSON &&patch)
+{
+    // values are moved out of the patch, which must not belong to another document
+    if (patch.child)
+        return merge_patch(static_cast<const JSON &>(patch));
+    if (patch.get_type() != JSON::GROUP || get_type() != JSON::GROUP)
+    {
+        if (child)
+            throw std::runtime_error("JSON::merge_patch(): cannot replace the root of a child handle");
+        Parser::release(node);
+        if (patch.get_type() != JSON::GROUP)
+        {
+            node = patch.node;
+            patch.child = true;
+            return;
+        }
+        node = Parser::create<Parser::Group>(Parser::Group::Members());
+    }
+    // pairs of objects still to merge, moved members are nulled in the patch
+    std::vector<std::pair<Parser::Group *, Parser::Group *>> pending;
+    pending.emplace_back(static_cast<Parser::Group *>(node), static_cast<Parser::Group *>(patch.node));
+    while (!pending.empty())
+    {
+        Parser::Group *target = pending.back().first;
+        auto &members = pending.back().second->member_table;
+        pending.pop_back();
+        for (auto &it : members)
+        {
+            Parser::Node *value = it.second;
+            if (value->is_null())
+                Parser::release(target->detach(Parser::to_std(it.first)));
+            else if (value->get_type() == Parser::GROUP)
+            {
+                Parser::Node *cur = target->find(Parser::to_std(it.first));
+                if (!cur || cur->get_type() != Parser::GROUP)
+                {
+                    cur = Parser::create<Parser::Group>(Parser::Group::Members());
+                    Parser::release(target->replace(Parser::to_std(it.first), cur));
+                }
+                pending.emplace_back(static_cast<Parser::Group *>(cur), static_cast<Parser::Group *>(value));
+            }
+            else
+            {
+                Parser::release(target->replace(Parser::to_std(it.first), value));
+                it.second = nullptr;
+            }
+        }
+    }
+}
+bool JSON::is_null() const
+{
+    return node->is_null();
+}
+
+uint64_t JSON::hash() const
+{
+    return Parser::hash(node);
+}
+bool JSON::operator==(const JSON &rhs) const
+{
+    return Parser::hash(node) == Parser::hash(rhs.node) && Parser::equal(node, rhs.node);
+}
+bool JSON::operator!=(const JSON &rhs) const
 {
-    json.child = true;
-    if (get_type() != JSON::GROUP)
-        throw std::runtime_error("JSON::add_pair type not matched expected a map");
-
-    static_cast<Parser::Group *>(node)->member_table.insert({str, json.node});
+    return !(*this == rhs);
 }
-void JSON::push(JSON json)
+
+JSON JSON::diff(const JSON &from, const JSON &to)
 {
-    json.child = true;
-    if (get_type() != JSON::ARRAY)
-        throw std::runtime_error("JSON::push type not matched expected an array");
+    auto escape = [](const std::string &key) {
+        std::string ret;
+        for (char ch : key)
+        {
+            if (ch == '~')
+                ret += "~0";
+            else if (ch == '/')
+                ret += "~1";
+            else
+                ret += ch;
+        }
+        return ret;
+    };
+    auto copy = [](Parser::Node *n) {
+        JSON tmp(JSON(n).stringify_unit("", 0, RAW_INLINE));
+        tmp.child = true;
+        return tmp.node;
+    };
+    std::vector<Parser::Node *> ops;
+    auto emit = [&ops](const char *op, const std::string &path, Parser::Node *value) {
+        Parser::Group::Members members;
+        members.emplace_back("op", Parser::create<Parser::Unit>(op));
+        members.emplace_back("path", Parser::create<Parser::Unit>(path));
+        if (value)
+            members.emplace_back("value", value);
+        ops.push_back(Parser::create<Parser::Group>(std::move(members)));
+    };
 
-    static_cast<Parser::Array *>(node)->elements.push_back(json.node);
+    struct Pending
+    {
+        Parser::Node *a;
+        Parser::Node *b;
+        std::string path;
+    };
+    std::vector<Pending> pending;
+    pending.push_back({from.node, to.node, std::string()});
+    try
+    {
+        while (!pending.empty())
+        {
+            Pending cur = std::move(pending.back());
+            pending.pop_back();
+            if (Parser::hash(cur.a) == Parser::hash(cur.b))
+                continue;
+            auto type = cur.a->get_type();
+            if (type != cur.b->get_type() || (type != Parser::GROUP && type != Parser::ARRAY))
+            {
+                emit("replace", cur.path, copy(cur.b));
+                continue;
+            }
+            if (type == Parser::GROUP)
+            {
+                // both tables are sorted, one merge pass pairs the keys
+                auto &x = static_cast<Parser::Group *>(cur.a)->member_table;
+                auto &y = static_cast<Parser::Group *>(cur.b)->member_table;
+                size_t i = 0, j = 0;
+                while (i < x.size() || j < y.size())
+                {
+                    if (j == y.size() || (i < x.size() && x[i].first < y[j].first))
+                    {
+                        emit("remove", cur.path + "/" + escape(Parser::to_std(x[i].first)), nullptr);
+                        i++;
+                    }
+                    else if (i == x.size() || y[j].first < x[i].first)
+                    {
+                        emit("add", cur.path + "/" + escape(Parser::to_std(y[j].first)), copy(y[j].second));
+                        j++;
+                    }
+                    else
+                    {
+                        pending.push_back({x[i].second, y[j].second, cur.path + "/" + escape(Parser::to_std(x[i].first))});
+                        i++, j++;
+                    }
+                }
+                continue;
+            }
+            // arrays are compared by index, the tail is removed from the back or appended
+            auto x = static_cast<Parser::Array *>(cur.a), y = static_cast<Parser::Array *>(cur.b);
+            size_t common = std::min(x->length(), y->length());
+            if (x->packed && y->packed)
+            {
+                for (size_t k = 0; k < common; k++)
+                {
+                    if ((*x->packed)[k] != (*y->packed)[k])
+                        emit("replace", cur.path + "/" + std::to_string(k), Parser::create<Parser::Integer>((*y->packed)[k]));
+                }
+            }
+            else
+            {
+                // a packed side is read in place, the inputs are not unpacked under the caller's spans
+                auto same_int = [](Parser::Node *n, int64_t v) {
+                    return n->get_type() == Parser::INT && !n->is_null() && Parser::Integer::get_integer(n) == v;
+                };
+                for (size_t k = 0; k < common; k++)
+                {
+                    std::string path = cur.path + "/" + std::to_string(k);
+                    if (y->packed)
+                    {
+                        if (!same_int(x->elements[k], (*y->packed)[k]))
+                            emit("replace", path, Parser::create<Parser::Integer>((*y->packed)[k]));
+                    }
+                    else if (x->packed)
+                    {
+                        if (!same_int(y->elements[k], (*x->packed)[k]))
+                            emit("replace", path, copy(y->elements[k]));
+                    }
+                    else
+                        pending.push_back({x->elements[k], y->elements[k], path});
+                }
+            }
+            for (size_t k = x->length(); k-- > common;)
+                emit("remove", cur.path + "/" + std::to_string(k), nullptr);
+            for (size_t k = common; k < y->length(); k++)
+                emit("add", cur.path + "/" + std::to_string(k),
+                     y->packed ? Parser::create<Parser::Integer>((*y->packed)[k]) : copy(y->elements[k]));
+        }
+    }
+    catch (...)
+    {
+        Parser::release(ops);
+        throw;
+    }
+    return JSON(false, Parser::create<Parser::Array>(std::move(ops)));
 }
 
 JSON JSON::clone() const
@@ -828,6 +4720,18 @@ size_t JSON::count() const
         return static_cast<Parser::Group *>(node)->count();
     return 0;
 }
+JSON::IntSpan JSON::get_ints() const
+{
+    if (node->get_type() != Parser::ARRAY || !static_cast<Parser::Array *>(node)->packed)
+        throw std::runtime_error("JSON::get_ints(): expected a packed integer array");
+    node->touch();
+    auto &vals = *static_cast<Parser::Array *>(node)->packed;
+    return IntSpan{vals.data(), vals.size()};
+}
+bool JSON::is_packed() const
+{
+    return node->get_type() == Parser::ARRAY && static_cast<Parser::Array *>(node)->packed;
+}
 size_t JSON::length() const
 {
     if (node->get_type() == Parser::ARRAY)
@@ -835,92 +4739,255 @@ size_t JSON::length() const
     return 0;
 }
 
-std::string JSON::stringify_unit(std::string indent, size_t indent_cnt, bool hide_raw) const
+std::string JSON::stringify_unit(std::string indent, size_t indent_cnt, RawFormat raw, bool cache, Sink *sink) const
 {
-    if (get_type() == JSON::INT)
-        return std::to_string(get_int());
-    else if (get_type() == JSON::STRING)
-        return "\"" + conv_str(get_str()) + "\"";
-    else if (get_type() == JSON::RAW)
+    // containers being written, the C++ stack stays flat however deep the document is
+    struct Frame
     {
-        auto cur = static_cast<Parser::Bytes *>(node);
-        if (hide_raw)
-            return "(raw-data:" + std::to_string(cur->raw_length()) + " Bytes)";
-        return "(" + std::to_string(cur->raw_length()) + ")$" + std::string(cur->get_raw().begin(), cur->get_raw().end()) + "$";
-    }
-    std::string indent_prefix;
-    indent_prefix.reserve(indent_cnt * indent.size());
-    for (int i = 1; i <= indent_cnt; i++)
-        indent_prefix += indent;
-
-    if (get_type() == JSON::ARRAY)
+        Parser::Node *node;
+        size_t idx;
+        Parser::Group::Members::const_iterator it;
+        // where the container starts in ret
+        size_t start;
+    };
+    // keeps what a container wrote, so it can be spliced while the container stays clean
+    auto store = [&](Parser::Node *cur, const std::string &ret, size_t start, size_t level) {
+        Parser::OutputCache *&slot = Parser::output_cache(cur);
+        if (!slot)
+            slot = new Parser::OutputCache();
+        slot->text.assign(ret, start, std::string::npos);
+        slot->indent = indent;
+        slot->level = level;
+    };
+    std::vector<Frame> stack;
+    std::string ret;
+    Parser::Node *cur = node;
+    while (true)
     {
-        std::string ret = "[\n";
-        auto &vec = static_cast<Parser::Array *>(node)->elements;
-        for (size_t i = 0; i < vec.size(); i++)
+        JSON_STATS(cur_stats->nodes[cur->get_type()]++;
+                   cur_stats->max_depth = std::max(cur_stats->max_depth, indent_cnt + stack.size() + 1));
+        if (sink && ret.size() >= STREAM_CHUNK)
+            sink->write(ret);
+        size_t depth = indent_cnt + stack.size();
+        if (cache)
         {
-            ret += indent_prefix + indent + JSON(vec[i]).stringify_unit(indent, indent_cnt + 1, hide_raw);
-            if (i != vec.size() - 1)
+            if (!cur->is_dirty() && (cur->get_type() == Parser::ARRAY || cur->get_type() == Parser::GROUP))
             {
-                ret += ",";
+                Parser::OutputCache *hit = Parser::output_cache(cur);
+                if (hit && hit->level == depth && hit->indent == indent)
+                {
+                    ret += hit->text;
+                    cur = nullptr;
+                }
             }
-            ret += "\n";
+            if (cur)
+                cur->clean();
         }
-        ret += indent_prefix + "]";
-        return ret;
-    }
-    if (get_type() == JSON::GROUP)
-    {
-        std::string ret = "{\n";
-        auto &mp = static_cast<Parser::Group *>(node)->member_table;
-        size_t idx = 0;
-        for (auto pair : mp)
+        size_t start = ret.size();
+        switch (cur ? cur->get_type() : 0)
+        {
+        case Parser::INT:
+            if (cur->is_null())
+                ret += "null";
+            else
+                append_int(ret, cur->get_int());
+            break;
+        case Parser::STRING:
+            ret += "\"" + conv_str(Parser::to_std(cur->get_str())) + "\"";
+            break;
+        case Parser::RAW:
         {
-            ret += indent_prefix + indent + "\"" + pair.first + "\": " + JSON(pair.second).stringify_unit(indent, indent_cnt + 1, hide_raw);
-            if (++idx != mp.size())
-                ret += ",\n";
+            auto bytes = static_cast<Parser::Bytes *>(cur);
+            if (raw == RAW_HIDDEN)
+                ret += "(raw-data:" + std::to_string(bytes->raw_length()) + " Bytes)";
+            else if (raw == RAW_BASE64)
+            {
+                // encoded straight into the output
+                ret += '\"';
+                ret += BASE64_PREFIX;
+                size_t at = ret.size(), len = base64_encoded_size(bytes->raw_length());
+                // keep growing geometrically, or the text after a large blob copies it again
+                if (ret.capacity() < at + len + 1)
+                    ret.reserve(std::max(at + len + 1, 2 * ret.capacity()) + 64);
+                ret.resize(at + len + 1);
+                base64_encode(bytes->get_raw().data(), bytes->raw_length(), &ret[at]);
+                ret.back() = '\"';
+            }
+            else
+            {
+                ret += "(" + std::to_string(bytes->raw_length()) + ")$";
+                ret.append(bytes->get_raw().begin(), bytes->get_raw().end());
+                ret += "$";
+            }
+            break;
+        }
+        case Parser::ARRAY:
+            ret += "[\n";
+            if (static_cast<Parser::Array *>(cur)->packed)
+            {
+                // packed integers are written in one tight loop
+                auto &vals = *static_cast<Parser::Array *>(cur)->packed;
+                JSON_STATS(cur_stats->nodes[JSON::INT] += vals.size());
+                std::string prefix;
+                for (size_t i = 0; i <= stack.size() + indent_cnt; i++)
+                    prefix += indent;
+                if (!sink)
+                    ret.reserve(ret.size() + vals.size() * (prefix.size() + 8));
+                for (size_t k = 0; k < vals.size(); k++)
+                {
+                    if (sink && ret.size() >= STREAM_CHUNK)
+                        sink->write(ret);
+                    if (k)
+                        ret += ",\n";
+                    ret += prefix;
+                    append_int(ret, vals[k]);
+                }
+                if (!vals.empty())
+                    ret += "\n";
+                ret.append(prefix, 0, prefix.size() - indent.size());
+                ret += "]";
+                if (cache)
+                    store(cur, ret, start, depth);
+            }
             else
+                stack.push_back({cur, 0, {}, start});
+            break;
+        case Parser::GROUP:
+            ret += "{\n";
+            stack.push_back({cur, 0, static_cast<Parser::Group *>(cur)->member_table.begin(), start});
+            break;
+        case 0:
+            // spliced from the cache
+            break;
+        default:
+            ret += "null";
+            break;
+        }
+
+        // find the next value to write, closing finished containers
+        cur = nullptr;
+        while (!stack.empty() && !cur)
+        {
+            Frame &top = stack.back();
+            size_t level = indent_cnt + stack.size();
+            size_t size = top.node->get_type() == Parser::ARRAY
+                              ? static_cast<Parser::Array *>(top.node)->elements.size()
+                              : static_cast<Parser::Group *>(top.node)->member_table.size();
+            if (top.idx < size)
+            {
+                if (top.idx)
+                    ret += ",\n";
+                for (size_t i = 0; i < level && !indent.empty(); i++)
+                    ret += indent;
+                if (top.node->get_type() == Parser::ARRAY)
+                    cur = static_cast<Parser::Array *>(top.node)->elements[top.idx];
+                else
+                {
+                    ret += "\"" + conv_str(Parser::to_std(top.it->first)) + "\": ";
+                    cur = top.it->second;
+                    ++top.it;
+                }
+                top.idx++;
+                continue;
+            }
+            if (size)
                 ret += "\n";
+            for (size_t i = 1; i < level && !indent.empty(); i++)
+                ret += indent;
+            ret += top.node->get_type() == Parser::ARRAY ? "]" : "}";
+            if (cache)
+                store(top.node, ret, top.start, level - 1);
+            stack.pop_back();
+        }
+        if (!cur)
+        {
+            if (sink)
+                sink->write(ret);
+            return ret;
         }
-        ret += indent_prefix + "}";
-        return ret;
     }
-    return "null";
 }
 
 std::string JSON::to_string(std::string indent) const
 {
-    return stringify_unit(indent, 0, true);
+    JSON_STATS_BEGIN("serialize", 0);
+    std::string ret = stringify_unit(indent, 0, RAW_HIDDEN);
+    JSON_STATS_LAP(WRITE);
+    JSON_STATS(cur_stats->bytes = ret.size());
+    JSON_STATS_END();
+    return ret;
+}
+
+std::string JSON::to_string(std::string indent, RawFormat raw) const
+{
+    JSON_STATS_BEGIN("serialize", 0);
+    std::string ret = stringify_unit(indent, 0, raw);
+    JSON_STATS_LAP(WRITE);
+    JSON_STATS(cur_stats->bytes = ret.size());
+    JSON_STATS_END();
+    return ret;
+}
+
+std::string JSON::to_string_cached(std::string indent) const
+{
+    JSON_STATS_BEGIN("serialize", 0);
+    std::string ret = stringify_unit(indent, 0, RAW_HIDDEN, true);
+    JSON_STATS_LAP(WRITE);
+    JSON_STATS(cur_stats->bytes = ret.size());
+    JSON_STATS_END();
+    return ret;
+}
+
+void JSON::drop_cache()
+{
+    std::vector<Parser::Node *> pending(1, node);
+    while (!pending.empty())
+    {
+        Parser::Node *cur = pending.back();
+        pending.pop_back();
+        if (cur->get_type() == Parser::ARRAY)
+            pending.insert(pending.end(), static_cast<Parser::Array *>(cur)->elements.begin(),
+                           static_cast<Parser::Array *>(cur)->elements.end());
+        else if (cur->get_type() == Parser::GROUP)
+        {
+            for (auto &it : static_cast<Parser::Group *>(cur)->member_table)
+                pending.push_back(it.second);
+        }
+        else
+            continue;
+        delete Parser::output_cache(cur);
+        Parser::output_cache(cur) = nullptr;
+    }
 }
 
 std::string JSON::view(std::string indent) const
 {
-    return stringify_unit(indent, 0, true);
+    JSON_STATS_BEGIN("serialize", 0);
+    std::string ret = stringify_unit(indent, 0, RAW_HIDDEN);
+    JSON_STATS_LAP(WRITE);
+    JSON_STATS(cur_stats->bytes = ret.size());
+    JSON_STATS_END();
+    return ret;
 }
 
 JSON::~JSON()
 {
     if (!child)
-        delete node;
+    {
+        JSON_STATS_BEGIN("destroy", 0);
+        Parser::release(node);
+        JSON_STATS_LAP(TEARDOWN);
+        JSON_STATS_END();
+    }
 }
 
 JSON JSON::raw(const std::vector<unsigned char> &vec)
 {
-    JSON ret;
-    //
-    ret.child = false;
-    ret.node = new Parser::Bytes(vec);
-
-    return ret;
+    return JSON(false, Parser::create<Parser::Bytes>(vec));
 }
 JSON JSON::raw(std::vector<unsigned char> &&vec)
 {
-    JSON ret;
-    //
-    ret.child = false;
-    ret.node = new Parser::Bytes(std::move(vec));
-
-    return ret;
+    return JSON(false, Parser::create<Parser::Bytes>(std::move(vec)));
 }
 // build json
 JSON JSON::val(int val)
@@ -949,20 +5016,21 @@ JSON JSON::array(const std::vector<JSON> &vec)
         item.child = true;
         tmp.push_back(item.node);
     }
-    Parser::Array *node = new Parser::Array(tmp);
+    Parser::Array *node = Parser::create<Parser::Array>(tmp);
     return JSON(false, node);
 }
 
 JSON JSON::map(const std::map<std::string, JSON> &table)
 {
-    // vector<JSON> -> vector<Node*>
-    std::map<std::string, Parser::Node *> tmp;
+    // map<string, JSON> -> sorted members
+    Parser::Group::Members tmp;
+    tmp.reserve(table.size());
     for (auto item : table)
     {
         item.second.child = true;
-        tmp.insert({item.first, item.second.node});
+        tmp.emplace_back(item.first, item.second.node);
     }
-    Parser::Group *node = new Parser::Group(tmp);
+    Parser::Group *node = Parser::create<Parser::Group>(std::move(tmp));
     return JSON(false, node);
 }
 
@@ -971,18 +5039,407 @@ JSON JSON::read_from_file(const std::string &filename)
     std::ifstream ifs(filename, std::ios::in | std::ios::binary);
     if (!ifs)
         throw std::runtime_error("open file " + filename + " failed\n");
-    char *file_content;
-    ifs.seekg(0, std::ios::end);
-    size_t file_length = ifs.tellg();
-    ifs.seekg(0, std::ios::beg);
+    return read_from(ifs);
+}
+JSON JSON::read_from(std::istream &in)
+{
+    JSON_STATS_BEGIN("parse", 0);
+    Source src(in);
+    Lexer::TokenStream ts;
+    std::string buf;
+    size_t want = STREAM_CHUNK;
+    bool more = true;
+    while (more)
+    {
+        more = src.read(buf, want);
+        size_t used = Lexer::build_token_stream(buf, ts, more);
+        JSON_STATS(cur_stats->bytes += used);
+        buf.erase(0, used);
+        // a token longer than a chunk doubles the next read, so it is not lexed over and over
+        want = std::max(STREAM_CHUNK, buf.size());
+    }
+    JSON_STATS_LAP(SCAN);
+    JSON ret(false, Parser::parse_unit(ts));
+    JSON_STATS_LAP(BUILD);
+
+    ts.clear();
+    JSON_STATS_LAP(TEARDOWN);
+    JSON_STATS_END();
+    return ret;
+}
+void JSON::write_to_file(const std::string &filename, Compression comp, std::string indent, RawFormat raw) const
+{
+    std::ofstream ofs(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs)
+        throw std::runtime_error("open file " + filename + " failed\n");
+    write_to(ofs, comp, indent, raw);
+}
+void JSON::write_to(std::ostream &out, Compression comp, std::string indent, RawFormat raw) const
+{
+    JSON_STATS_BEGIN("serialize", 0);
+    Sink sink(out, comp);
+    stringify_unit(indent, 0, raw, false, &sink);
+    sink.finish();
+    JSON_STATS_LAP(WRITE);
+    JSON_STATS(cur_stats->bytes = sink.bytes);
+    JSON_STATS_END();
+}
+JSON::ErrorCode JSON::try_parse(const std::string &str, JSON &out, Error *err)
+{
+    return try_parse(str, out, err, ParseOptions());
+}
+
+JSON::ErrorCode JSON::try_parse(const std::string &str, JSON &out, Error *err, const ParseOptions &opts)
+{
+    Error tmp;
+    if (!validate(str, opts, err ? *err : tmp))
+        return err ? err->code : tmp.code;
+    JSON ret(false, parse_text(str, opts.decode_base64));
+    ret.build_indexes(opts);
+    if (!out.child)
+        Parser::release(out.node);
+    out.node = ret.node;
+    out.child = false;
+    ret.child = true;
+    if (err)
+        *err = Error();
+    return ERR_NONE;
+}
+
+bool JSON::validate(const std::string &str, const ParseOptions &opts, Error &err)
+{
+    size_t pos = 0;
+    ErrorCode code = Lexer::Validator(str, opts).run(pos);
+    if (code == ERR_NONE)
+        return true;
+    err.code = code;
+    err.offset = pos;
+    err.line = 1;
+    err.column = 1;
+    for (size_t i = 0; i < pos && i < str.size(); i++)
+    {
+        if (str[i] == '\n')
+            err.line++, err.column = 1;
+        else
+            err.column++;
+    }
+    return false;
+}
+
+const char *JSON::error_message(ErrorCode code)
+{
+    switch (code)
+    {
+    case ERR_NONE:
+        return "no error";
+    case ERR_UNEXPECTED_END:
+        return "unexpected end of input";
+    case ERR_UNEXPECTED_CHAR:
+        return "unexpected character";
+    case ERR_BAD_WORD:
+        return "unknown word, expected true, false or null";
+    case ERR_BAD_NUMBER:
+        return "integer out of range";
+    case ERR_BAD_ESCAPE:
+        return "invalid escape sequence";
+    case ERR_BAD_UTF8:
+        return "invalid UTF8 sequence";
+    case ERR_BAD_RAW:
+        return "invalid raw data, use (length)$raw_content$";
+    case ERR_EXPECTED_VALUE:
+        return "expected a value";
+    case ERR_EXPECTED_KEY:
+        return "expected a string key";
+    case ERR_EXPECTED_COLON:
+        return "expected ':'";
+    case ERR_EXPECTED_COMMA:
+        return "expected ',' or a closing bracket";
+    case ERR_TRAILING_CHARS:
+        return "unexpected characters after the value";
+    case ERR_TOO_DEEP:
+        return "nesting too deep";
+    case ERR_TOO_MANY_NODES:
+        return "too many values";
+    case ERR_STRING_TOO_LONG:
+        return "string too long";
+    case ERR_RAW_TOO_LARGE:
+        return "raw data too large";
+    case ERR_BAD_BASE64:
+        return "invalid base64 data";
+    case ERR_SCHEMA_TYPE:
+        return "value of the wrong type for the schema";
+    case ERR_SCHEMA_RANGE:
+        return "value out of the schema's range";
+    case ERR_SCHEMA_REQUIRED:
+        return "required key missing";
+    case ERR_SCHEMA_UNKNOWN_KEY:
+        return "key not allowed by the schema";
+    }
+    return "unknown error";
+}
+
+//              ===== Snapshot ======
+JSON::JSONTYPE JSON::View::get_type() const
+{
+    return slot == std::string::npos ? (JSONTYPE)node->get_type() : JSON::INT;
+}
+bool JSON::View::is_null() const
+{
+    return slot == std::string::npos && node->is_null();
+}
+int64_t JSON::View::get_int() const
+{
+    if (slot != std::string::npos)
+        return (*static_cast<Parser::Array *>(node)->packed)[slot];
+    return node->get_int();
+}
+const JSON::String &JSON::View::get_str() const
+{
+    if (slot != std::string::npos)
+        throw std::runtime_error("type not matched");
+    return node->get_str();
+}
+const JSON::RawData &JSON::View::get_raw() const
+{
+    if (slot != std::string::npos)
+        throw std::runtime_error("type not matched excepted a bytes");
+    return node->get_raw();
+}
+std::map<std::string, JSON::View> JSON::View::get_map() const
+{
+    if (get_type() != JSON::GROUP)
+        throw std::runtime_error("JSON::View::get_map(): expected a GROUP");
+    std::map<std::string, View> ret;
+    for (auto &val : static_cast<Parser::Group *>(node)->member_table)
+        ret.emplace_hint(ret.end(), val.first, View(val.second));
+    return ret;
+}
+std::vector<JSON::View> JSON::View::get_list() const
+{
+    if (get_type() != JSON::ARRAY)
+        throw std::runtime_error("JSON::View::get_list(): expected an array");
+    std::vector<View> ret;
+    auto arr = static_cast<Parser::Array *>(node);
+    // packed values are viewed in place, unpacking would write to the tree
+    for (size_t k = 0; k < arr->length(); k++)
+        ret.push_back(arr->packed ? View(node, k) : View(arr->elements[k]));
+    return ret;
+}
+JSON::View JSON::View::operator[](const std::string &str) const
+{
+    if (get_type() != JSON::GROUP)
+        throw std::runtime_error("type not matched, expected an array!");
+    return View(static_cast<Parser::Group *>(node)->operator[](str));
+}
+JSON::View JSON::View::operator[](size_t idx) const
+{
+    if (get_type() != JSON::ARRAY)
+        throw std::runtime_error("type not matched, expected an array!");
+    auto arr = static_cast<Parser::Array *>(node);
+    if (idx >= arr->length())
+        throw std::runtime_error("Array out of range!");
+    return arr->packed ? View(node, idx) : View(arr->elements[idx]);
+}
+bool JSON::View::find(const Pointer &ptr, View &out) const
+{
+    View cur = *this;
+    for (auto &step : ptr.steps)
+    {
+        if (cur.get_type() == JSON::GROUP)
+            cur.node = static_cast<Parser::Group *>(cur.node)->find(step.key, step.slot_hint);
+        else if (cur.get_type() == JSON::ARRAY && step.index < cur.length())
+            cur = cur[step.index];
+        else
+            return false;
+        if (!cur.node)
+            return false;
+    }
+    out = cur;
+    return true;
+}
+size_t JSON::View::count() const
+{
+    return get_type() == JSON::GROUP ? static_cast<Parser::Group *>(node)->count() : 0;
+}
+size_t JSON::View::length() const
+{
+    return get_type() == JSON::ARRAY ? static_cast<Parser::Array *>(node)->length() : 0;
+}
+uint64_t JSON::View::hash() const
+{
+    if (slot != std::string::npos)
+        return Parser::hash_int(get_int(), false);
+    return Parser::hash(node);
+}
+bool JSON::View::operator==(const View &rhs) const
+{
+    if (slot != std::string::npos || rhs.slot != std::string::npos)
+        return get_type() == rhs.get_type() && !rhs.is_null() && !is_null() && get_int() == rhs.get_int();
+    return Parser::hash(node) == Parser::hash(rhs.node) && Parser::equal(node, rhs.node);
+}
+bool JSON::View::operator!=(const View &rhs) const
+{
+    return !(*this == rhs);
+}
+std::string JSON::View::to_string(std::string indent) const
+{
+    if (slot != std::string::npos)
+        return std::to_string(get_int());
+    return JSON(node).to_string(indent);
+}
+JSON JSON::View::clone() const
+{
+    if (slot != std::string::npos)
+        return JSON(std::to_string(get_int()));
+    return JSON(JSON(node).stringify_unit("", 0, RAW_INLINE));
+}
+
+JSON::Snapshot::Snapshot(const std::string &str) : node(nullptr)
+{
+    JSON tmp(str);
+    tmp.child = true;
+    node = tmp.node;
+    freeze();
+}
+JSON::Snapshot::Snapshot(const JSON &json) : Snapshot(json.stringify_unit("", 0, RAW_INLINE))
+{
+}
+JSON::Snapshot::Snapshot(JSON &&json) : node(nullptr)
+{
+    if (json.child)
+    {
+        JSON tmp(json.stringify_unit("", 0, RAW_INLINE));
+        tmp.child = true;
+        node = tmp.node;
+    }
+    else
+    {
+        // the handle must not stay an alias of the frozen tree
+        node = json.node;
+        json.node = Parser::create<Parser::Group>(Parser::Group::Members());
+    }
+    freeze();
+}
+JSON::Snapshot::~Snapshot()
+{
+    Parser::release(node);
+}
+void JSON::Snapshot::freeze()
+{
+    Parser::hash(node);
+}
+
+namespace
+{
+    // spreads threads over the reader counters
+    size_t reader_stripe()
+    {
+        static std::atomic<size_t> next(0);
+        thread_local size_t stripe = next++;
+        return stripe;
+    }
+}
+JSON::Publisher::Publisher(std::shared_ptr<const Snapshot> first)
+    : epoch(0), current(new std::shared_ptr<const Snapshot>(std::move(first)))
+{
+    for (auto &row : readers)
+        for (auto &counter : row)
+            counter.value = 0;
+}
+JSON::Publisher::~Publisher()
+{
+    delete current.load();
+}
+std::shared_ptr<const JSON::Snapshot> JSON::Publisher::get() const
+{
+    size_t stripe = reader_stripe() % STRIPES;
+    while (true)
+    {
+        unsigned e = epoch.load();
+        readers[e][stripe].value++;
+        // a publish flipped the epoch in between, it may not have seen this reader
+        if (epoch.load() != e)
+        {
+            readers[e][stripe].value--;
+            continue;
+        }
+        std::shared_ptr<const Snapshot> ret = *current.load();
+        readers[e][stripe].value--;
+        return ret;
+    }
+}
+void JSON::Publisher::publish(std::shared_ptr<const Snapshot> next)
+{
+    std::lock_guard<std::mutex> lock(writer);
+    std::shared_ptr<const Snapshot> *old = current.exchange(new std::shared_ptr<const Snapshot>(std::move(next)));
+    // readers that entered before the flip may still be copying old, new ones see the new slot
+    unsigned e = epoch.load();
+    epoch.store(e ^ 1);
+    for (auto &counter : readers[e])
+    {
+        while (counter.value.load())
+            std::this_thread::yield();
+    }
+    delete old;
+}
+
+#ifdef JSON_LITE_PMR
+JSON::ResourceScope::ResourceScope(std::pmr::memory_resource *res) : prev(Parser::cur_resource)
+{
+    Parser::cur_resource = res;
+}
+JSON::ResourceScope::~ResourceScope()
+{
+    Parser::cur_resource = prev;
+}
+#endif
 
-    file_content = new char[file_length];
+//              ===== Context ======
+struct JSON::Context::Impl
+{
+    // the stream gives its tokens back to the pool when cleared, so it goes first
+    Lexer::TokenPool tokens;
+    Lexer::TokenStream ts{&tokens};
+    Parser::NodePool nodes;
+    std::vector<Parser::Node *> docs;
+};
+JSON::Context::Context() : impl(new Impl) {}
+JSON::Context::~Context()
+{
+    Parser::release(impl->docs);
+    delete impl;
+}
+JSON JSON::Context::parse(const std::string &str)
+{
+    JSON_STATS_BEGIN("parse", str.size());
+    impl->ts.clear();
+    Lexer::build_token_stream(str, impl->ts);
+    JSON_STATS_LAP(SCAN);
+    impl->docs.reserve(impl->docs.size() + 1);
+    Parser::Node *node = Parser::parse_unit(impl->ts, &impl->nodes);
+    impl->docs.push_back(node);
+    JSON_STATS_LAP(BUILD);
 
-    ifs.read(file_content, file_length);
-    ifs.close();
+    impl->ts.clear();
+    JSON_STATS_LAP(TEARDOWN);
+    JSON_STATS_END();
+    return JSON(node);
+}
+void JSON::Context::reset()
+{
+    for (auto doc : impl->docs)
+        impl->nodes.recycle(doc);
+    impl->docs.clear();
+}
 
-    std::string str(file_content, file_content + file_length);
-    delete[] file_content;
-    return JSON(str);
+#ifdef JSON_LITE_STATS
+void JSON::set_stats_hook(StatsHook hook)
+{
+    stats_hook() = std::move(hook);
+}
+const JSON::Stats &JSON::last_stats()
+{
+    return last_stats_slot;
 }
+#endif
 //             end ===== JSON defination ======
\ No newline at end of file
@@ -4,10 +4,24 @@
 #include <vector>
 #include <set>
 #include <cinttypes>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#ifdef JSON_LITE_STATS
+#include <functional>
+#endif
+#ifdef JSON_LITE_PMR
+#include <memory_resource>
+#endif
 
+namespace Lexer
+{
+    class Validator;
+}
 namespace Parser
 {
     class Node;
+    class Projector;
 }
 class JSON
 {
@@ -20,8 +34,291 @@ public:
         GROUP = 4,
         RAW
     };
+    // the storage of string and raw values. with JSON_LITE_PMR (C++17) every node, string and
+    // container of a document is allocated from a std::pmr::memory_resource, see ResourceScope
+#ifdef JSON_LITE_PMR
+    typedef std::pmr::string String;
+    typedef std::pmr::vector<unsigned char> RawData;
+#else
+    typedef std::string String;
+    typedef std::vector<unsigned char> RawData;
+#endif
+    enum ErrorCode
+    {
+        ERR_NONE = 0,
+        ERR_UNEXPECTED_END,
+        ERR_UNEXPECTED_CHAR,
+        ERR_BAD_WORD,
+        ERR_BAD_NUMBER,
+        ERR_BAD_ESCAPE,
+        ERR_BAD_UTF8,
+        ERR_BAD_RAW,
+        ERR_EXPECTED_VALUE,
+        ERR_EXPECTED_KEY,
+        ERR_EXPECTED_COLON,
+        ERR_EXPECTED_COMMA,
+        ERR_TRAILING_CHARS,
+        ERR_TOO_DEEP,
+        ERR_TOO_MANY_NODES,
+        ERR_STRING_TOO_LONG,
+        ERR_RAW_TOO_LARGE,
+        ERR_BAD_BASE64,
+        // the document breaks ParseOptions::schema
+        ERR_SCHEMA_TYPE,
+        ERR_SCHEMA_RANGE,
+        ERR_SCHEMA_REQUIRED,
+        ERR_SCHEMA_UNKNOWN_KEY
+    };
+    // where a parse failed, line and column are 1-based and count bytes
+    struct Error
+    {
+        ErrorCode code = ERR_NONE;
+        size_t offset = 0;
+        size_t line = 0;
+        size_t column = 0;
+    };
+    class Schema;
+    // limits are checked by a scan of the input before anything is allocated, 0 means unlimited
+    struct ParseOptions
+    {
+        size_t max_depth = 0;
+        size_t max_nodes = 0;
+        // decoded bytes, applies to keys too
+        size_t max_string_length = 0;
+        size_t max_raw_size = 0;
+        // strings holding a "data:application/octet-stream;base64," URI, as written by
+        // RAW_BASE64, become raw data. max_raw_size applies to the decoded bytes
+        bool decode_base64 = false;
+        // checked by the same scan, must outlive the parse
+        const Schema *schema = nullptr;
+        // (array, field) pairs of JSON Pointers, each array gets create_index(field) as soon
+        // as the tree is built. paths not leading to an array are skipped
+        std::vector<std::pair<std::string, std::string>> indexes;
+    };
+    // a subset of JSON Schema compiled into a table of rules. the scan run for ParseOptions
+    // steps through the rules as it reads, so a document is rejected at the first byte that
+    // breaks the schema and before any node is built. the keywords are type (string, integer,
+    // number, boolean, null, array, object and raw for raw data), properties, required,
+    // additionalProperties (true or false), items, minimum, maximum, minLength and maxLength
+    // (chars of a string, bytes of raw data), minItems and maxItems. others are ignored
+    class Schema
+    {
+    public:
+        // throws std::runtime_error if the schema is malformed
+        Schema(const std::string &text);
+
+    private:
+        friend class Lexer::Validator;
+        enum Type
+        {
+            T_STRING = 1,
+            T_INTEGER = 2,
+            T_BOOLEAN = 4,
+            T_NULL = 8,
+            T_ARRAY = 16,
+            T_OBJECT = 32,
+            T_RAW = 64,
+            T_ANY = 127
+        };
+        // the rule of a value the schema says nothing about
+        static const size_t ANY = size_t(-1);
+        struct Property
+        {
+            std::string key;
+            size_t rule;
+            // the bit of a required key in the seen set, ANY if optional
+            size_t bit;
+        };
+        struct Rule
+        {
+            unsigned types = T_ANY;
+            int64_t minimum = INT64_MIN;
+            int64_t maximum = INT64_MAX;
+            size_t min_length = 0;
+            size_t max_length = size_t(-1);
+            size_t min_items = 0;
+            size_t max_items = size_t(-1);
+            // sorted by key
+            std::vector<Property> properties;
+            size_t required = 0;
+            bool additional = true;
+            size_t items = ANY;
+        };
+        // the root is rules[0]
+        std::vector<Rule> rules;
+    };
+    // a JSON Pointer (RFC 6901) parsed once, for lookups repeated over many documents.
+    // every step remembers the member slot it matched last, so documents sharing a schema
+    // skip the binary search. the hints make a Pointer unsafe to share between threads
+    class Pointer
+    {
+    public:
+        Pointer(const std::string &path);
+        size_t size() const { return steps.size(); }
+        const std::string &key(size_t idx) const { return steps[idx].key; }
+        // std::string::npos unless the step is a valid array index
+        size_t index(size_t idx) const { return steps[idx].index; }
+
+    private:
+        friend class JSON;
+        struct Step
+        {
+            std::string key;
+            // npos unless key is an array index
+            size_t index;
+            mutable size_t slot_hint;
+        };
+        std::vector<Step> steps;
+    };
+    // a compiled set of paths for projection-aware parsing. each path is a JSON Pointer
+    // like "/user/id", a "*" step matches every key or index, "" selects the whole document.
+    // arrays keep their indices, skipped elements before a selected one are null
+    class Projection
+    {
+    public:
+        Projection(const std::vector<std::string> &paths);
+
+    private:
+        // adds the subtree at src to the one at dst
+        void merge(size_t dst, size_t src);
+        friend class Parser::Projector;
+        struct Step
+        {
+            std::map<std::string, size_t> keys;
+            std::map<size_t, size_t> indices;
+            // index of the "*" step, 0 for none
+            size_t any = 0;
+            bool terminal = false;
+        };
+        std::vector<Step> steps;
+    };
+    class Snapshot;
+    // a read-only handle into a Snapshot, nothing reachable from it mutates the tree,
+    // so any number of threads may use views of the same snapshot
+    class View
+    {
+    public:
+        View() = default;
+        JSONTYPE get_type() const;
+        bool is_null() const;
+        int64_t get_int() const;
+        const String &get_str() const;
+        const RawData &get_raw() const;
+        std::map<std::string, View> get_map() const;
+        std::vector<View> get_list() const;
+        View operator[](const std::string &str) const;
+        View operator[](size_t idx) const;
+        // ptr must not be shared between threads, see Pointer
+        bool find(const Pointer &ptr, View &out) const;
+        size_t count() const;
+        size_t length() const;
+        uint64_t hash() const;
+        bool operator==(const View &rhs) const;
+        bool operator!=(const View &rhs) const;
+        std::string to_string(std::string indent = "    ") const;
+        // a mutable deep copy
+        JSON clone() const;
+
+    private:
+        friend class Snapshot;
+        friend class ::JSON;
+        View(Parser::Node *n, size_t s = std::string::npos) : node(n), slot(s) {}
+        Parser::Node *node = nullptr;
+        // the element of a packed array, npos for node itself
+        size_t slot = std::string::npos;
+    };
+    // an immutable document, share it through std::shared_ptr<const Snapshot>
+    class Snapshot
+    {
+    public:
+        explicit Snapshot(const std::string &str);
+        // deep copies the document, later edits through json do not reach the snapshot
+        explicit Snapshot(const JSON &json);
+        // takes over the tree of an owning temporary, json is left holding an empty object.
+        // a child handle is deep copied
+        explicit Snapshot(JSON &&json);
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        ~Snapshot();
+        View root() const { return View(node); }
+
+    private:
+        // computes every lazy hash, so reading never writes to the tree
+        void freeze();
+        Parser::Node *node;
+    };
+    // holds the current snapshot of a hot reloaded document.
+    // readers never wait on a publish, they only retry while the epoch flips
+    class Publisher
+    {
+    public:
+        explicit Publisher(std::shared_ptr<const Snapshot> first);
+        Publisher(const Publisher &) = delete;
+        Publisher &operator=(const Publisher &) = delete;
+        ~Publisher();
+        std::shared_ptr<const Snapshot> get() const;
+        // swaps in next, then waits on the calling thread until no reader can still be
+        // taking the previous one. the previous snapshot lives on while a reader holds it
+        void publish(std::shared_ptr<const Snapshot> next);
+
+    private:
+        static const size_t STRIPES = 16;
+        // readers inside get(), per epoch and spread over cache lines by thread
+        struct alignas(64) Counter
+        {
+            std::atomic<size_t> value;
+        };
+        mutable Counter readers[2][STRIPES];
+        std::atomic<unsigned> epoch;
+        std::atomic<std::shared_ptr<const Snapshot> *> current;
+        std::mutex writer;
+    };
+    // parses many documents into recycled memory, for servers handling one request after
+    // another. tokens, nodes and their buffers are kept by reset() and reused by the next
+    // parse, so once the context has seen documents of the usual size parsing stops
+    // allocating. not thread safe, use one context per thread
+    class Context
+    {
+    public:
+        Context();
+        Context(const Context &) = delete;
+        Context &operator=(const Context &) = delete;
+        ~Context();
+        // the returned handle does not own the document, it is valid until reset()
+        JSON parse(const std::string &str);
+        // takes back every document parsed since the last reset
+        void reset();
+
+    private:
+        struct Impl;
+        Impl *impl;
+    };
+
+#ifdef JSON_LITE_PMR
+    // nodes made on this thread while the scope lives come from res, whether by parsing,
+    // val(), map(), array() or edits. nodes made inside a document, like unpacked integers,
+    // take the resource of their container. every node remembers its resource, so one
+    // document may mix several, and each resource must outlive the nodes taken from it
+    class ResourceScope
+    {
+    public:
+        explicit ResourceScope(std::pmr::memory_resource *res);
+        ResourceScope(const ResourceScope &) = delete;
+        ResourceScope &operator=(const ResourceScope &) = delete;
+        ~ResourceScope();
+
+    private:
+        std::pmr::memory_resource *prev;
+    };
+#endif
+
     JSON();
     JSON(const std::string &str);
+    // rejects malformed input like try_parse does, throws on failure
+    JSON(const std::string &str, const ParseOptions &opts);
+    // builds only the selected paths plus the objects and arrays leading to them,
+    // other subtrees are skipped without being tokenized
+    JSON(const std::string &str, const Projection &proj);
 
     JSON(const JSON &rhs);
     JSON(JSON &&rhs);
@@ -32,18 +329,129 @@ public:
     JSONTYPE get_type() const;
 
     int64_t& get_int()const;
-    std::string& get_str()const;
-    std::vector<unsigned char> &get_raw() const;
+    String &get_str() const;
+    RawData &get_raw() const;
 
     std::map<std::string, JSON> get_map() const;
     std::vector<JSON> get_list() const;
 
     JSON operator[](const std::string &str);
     JSON operator[](size_t idx);
+    // false if the path does not exist, out then stays untouched
+    bool find(const Pointer &ptr, JSON &out) const;
+    // the same for reading, an element of a packed array is read in place where the
+    // mutable handle above unpacks the array. valid until the document is edited
+    bool find(const Pointer &ptr, View &out) const;
+    // throws if the path does not exist
+    JSON at(const Pointer &ptr) const;
 
     void add_pair(const std::string &str, JSON);
     void push(JSON);
 
+    // in place edits, values are moved into the document.
+    // adds the key or overwrites its value
+    void set(const std::string &str, JSON);
+    // false if the key is absent
+    bool erase(const std::string &str);
+    // idx may be length() to append
+    void insert(size_t idx, JSON);
+    void set(size_t idx, JSON);
+    void erase(size_t idx);
+    // unlinks the value at ptr and returns it as an owning handle, moving a subtree
+    // is detach() followed by set() or insert(). throws if the path does not exist
+    JSON detach(const Pointer &ptr);
+    // applies an RFC 6902 JSON Patch, an array of operations. a patch passed as a
+    // temporary owning handle gives up its values, so the cost follows the patch size,
+    // any other patch is copied and left intact. throws on the first failing operation,
+    // the ones before it stay applied
+    void apply_patch(const JSON &patch);
+    void apply_patch(JSON &&patch);
+    // applies an RFC 7396 Merge Patch, null members remove keys. patches are taken like
+    // apply_patch does
+    void merge_patch(const JSON &patch);
+    void merge_patch(JSON &&patch);
+    // null parses as the integer 0, this tells the two apart
+    bool is_null() const;
+
+    // 64-bit structural hash, computed on first use and kept by every object and array
+    // until it changes. member order does not matter, packed and unpacked arrays agree
+    uint64_t hash() const;
+    // deep comparison, returns early when the hashes differ
+    bool operator==(const JSON &rhs) const;
+    bool operator!=(const JSON &rhs) const;
+    // a JSON Patch turning from into to, for apply_patch. only subtrees whose hashes
+    // differ are visited, equal hashes are taken as equal subtrees
+    static JSON diff(const JSON &from, const JSON &to);
+
+    // arrays holding only integers are parsed into one packed int64_t buffer
+    struct IntSpan
+    {
+        int64_t *ptr;
+        size_t len;
+        int64_t *begin() const { return ptr; }
+        int64_t *end() const { return ptr + len; }
+        size_t size() const { return len; }
+        int64_t &operator[](size_t idx) const { return ptr[idx]; }
+    };
+    // throws unless the array is packed. operator[](size_t), get_list() and adding
+    // elements unpack the array into nodes, which invalidates the span
+    IntSpan get_ints() const;
+    bool is_packed() const;
+
+    // one field of an array of objects, laid out for batch processing
+    struct Column
+    {
+        // type is INT, STRING or RAW
+        Column(const std::string &_name, JSONTYPE _type) : name(_name), type(_type), offsets(1, 0) {}
+        struct CharSpan
+        {
+            const char *ptr;
+            size_t len;
+            const char *begin() const { return ptr; }
+            const char *end() const { return ptr + len; }
+            size_t size() const { return len; }
+            std::string str() const { return std::string(ptr, len); }
+        };
+        bool is_null(size_t row) const { return nulls[row / 64] >> (row % 64) & 1; }
+        // the key is absent, the row is not an object or the value has another type
+        bool is_missing(size_t row) const { return missing[row / 64] >> (row % 64) & 1; }
+        // a STRING or RAW value, empty when missing or null
+        CharSpan get_str(size_t row) const { return CharSpan{data.data() + offsets[row], offsets[row + 1] - offsets[row]}; }
+        // keeps the capacity for the next batch
+        void clear();
+
+        std::string name;
+        JSONTYPE type;
+        size_t rows = 0;
+        // INT values, 0 when missing or null
+        std::vector<int64_t> ints;
+        // STRING and RAW values, row k is data[offsets[k], offsets[k + 1])
+        std::string data;
+        std::vector<size_t> offsets;
+        // one bit per row, 64 rows a word
+        std::vector<uint64_t> nulls;
+        std::vector<uint64_t> missing;
+    };
+    // appends a row to every column for each element of this array, in one pass.
+    // object members are looked up where the previous row had them
+    void get_columns(std::vector<Column> &cols) const;
+    // the same straight from the text of an array, no tree is built. throws on malformed
+    // text, the columns may then hold part of a row
+    static void read_columns(const std::string &str, std::vector<Column> &cols);
+
+    // keyed lookups in an array of objects, like a routing table looked up by "/id".
+    // field is a JSON Pointer into each element, the index maps the hash of the value found
+    // there to the element. edits through this class and the get_*() references keep it
+    // current: pushed, inserted and removed elements are keyed at once, an element changed
+    // inside is keyed again by the next lookup. the array is unpacked, copies have no index
+    void create_index(const std::string &field) const;
+    // false if the array has no index on field
+    bool drop_index(const std::string &field) const;
+    // false if no element holds key at field, out then stays untouched. builds the index on
+    // first use, after that a lookup costs O(log n). with duplicated keys any match is returned
+    bool find_by(const std::string &field, const std::string &key, JSON &out) const;
+    bool find_by(const std::string &field, int64_t key, JSON &out) const;
+
     // copy json
     JSON clone() const;
     // for map
@@ -52,9 +460,45 @@ public:
     size_t length() const;
     std::string view(std::string indent = "    ") const;
     std::string to_string(std::string indent = "    ") const;
+    // how raw data is written
+    enum RawFormat
+    {
+        // (raw-data:N Bytes), a summary that does not parse back. to_string and view use it
+        RAW_HIDDEN,
+        // the (len)$bytes$ extension
+        RAW_INLINE,
+        // a base64 data URI string, standard json that ParseOptions::decode_base64 reads back
+        RAW_BASE64
+    };
+    std::string to_string(std::string indent, RawFormat raw) const;
+    // same output as to_string, but every object and array keeps what it wrote and later
+    // calls splice it back while the subtree is unchanged. edits through this class and the
+    // get_*() references mark the path up to the root as changed
+    std::string to_string_cached(std::string indent = "    ") const;
+    // frees the output kept by to_string_cached
+    void drop_cache();
     ~JSON();
 
+    enum Compression
+    {
+        PLAIN,
+        // needs JSON_LITE_ZLIB and linking with -lz
+        GZIP
+    };
+    // gzip input is recognized by its magic bytes. the text is inflated and tokenized
+    // chunk by chunk, so it is never held in memory as a whole
     static JSON read_from_file(const std::string &filename);
+    static JSON read_from(std::istream &in);
+    // writes the to_string() layout with raw data in full, in chunks that are
+    // compressed on the way
+    void write_to_file(const std::string &filename, Compression comp = PLAIN, std::string indent = "    ",
+                       RawFormat raw = RAW_INLINE) const;
+    void write_to(std::ostream &out, Compression comp = PLAIN, std::string indent = "    ",
+                  RawFormat raw = RAW_INLINE) const;
+    // never throws, out is only replaced on success, err may be null
+    static ErrorCode try_parse(const std::string &str, JSON &out, Error *err = nullptr);
+    static ErrorCode try_parse(const std::string &str, JSON &out, Error *err, const ParseOptions &opts);
+    static const char *error_message(ErrorCode code);
     static JSON raw(const std::vector<unsigned char> &vec);
     static JSON raw(std::vector<unsigned char> &&vec);
     static JSON val(int val);
@@ -62,13 +506,60 @@ public:
     static JSON map(const std::map<std::string, JSON> &table);
     static JSON array(const std::vector<JSON> &vec);
 
+#ifdef JSON_LITE_STATS
+    // opt-in instrumentation, build with -DJSON_LITE_STATS to enable it.
+    struct Stats
+    {
+        enum Phase
+        {
+            SCAN,
+            BUILD,
+            TEARDOWN,
+            WRITE,
+            PHASE_CNT
+        };
+        // bytes consumed by a parse or produced by a serialization
+        size_t bytes = 0;
+        // indexed by JSONTYPE, ARRAY and GROUP count the opening brackets
+        size_t tokens[RAW + 1] = {};
+        // closing brackets, commas, colons and line breaks
+        size_t other_tokens = 0;
+        // indexed by JSONTYPE
+        size_t nodes[RAW + 1] = {};
+        size_t escaped_strings = 0;
+        size_t plain_strings = 0;
+        size_t max_depth = 0;
+        // approximate, object sizes plus payload bytes
+        size_t bytes_allocated = 0;
+        uint64_t phase_ns[PHASE_CNT] = {};
+    };
+    // event is "parse", "serialize" or "destroy"
+    typedef std::function<void(const char *event, const Stats &)> StatsHook;
+    // not thread safe, install the hook before parsing starts
+    static void set_stats_hook(StatsHook hook);
+    // stats of the last event on the calling thread
+    static const Stats &last_stats();
+#endif
+
 private:
     friend JSON raw(const std::vector<unsigned char> &vec);
     friend JSON raw(std::vector<unsigned char> &&vec);
 
     JSON(bool _child, Parser::Node *n) : child(_child), node(n) {}
     JSON(Parser::Node *n);
-    std::string stringify_unit(std::string indent, size_t indent_cnt, bool hide_raw) const;
+    static bool validate(const std::string &str, const ParseOptions &opts, Error &err);
+    // the indexes asked for by ParseOptions::indexes
+    void build_indexes(const ParseOptions &opts) const;
+    // the node reached by the first count steps of ptr, nullptr if there is none
+    Parser::Node *locate(const Pointer &ptr, size_t count) const;
+    // removes the node at ptr from its container, nullptr if there is none
+    Parser::Node *unlink(const Pointer &ptr);
+    // receives the output of stringify_unit in chunks
+    struct Sink;
+    // cache reuses and refreshes the output kept by clean objects and arrays.
+    // with a sink the text is handed over as it grows and nothing is returned, no cache then
+    std::string stringify_unit(std::string indent, size_t indent_cnt, RawFormat raw, bool cache = false,
+                               Sink *sink = nullptr) const;
     mutable bool child = false;
     Parser::Node *node;
 };
\ No newline at end of file
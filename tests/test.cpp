@@ -1,5 +1,11 @@
 #include "../src/json_parser.hpp"
+#include "../src/json_bind.hpp"
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+#include <new>
 int tot_assert = 0;
 int failed_assert_cnt = 0;
 template <typename T, typename U>
@@ -25,6 +31,67 @@ void CHECK_NE(T a, U b)
   }
 }
 
+// counts heap allocations, for the tests of the pool. every form of new and delete
+// goes through the same malloc and free
+std::atomic<size_t> allocations(0);
+void *counted_alloc(size_t size) noexcept
+{
+  allocations++;
+  return std::malloc(size ? size : 1);
+}
+// out of line, so the compiler does not pair an inlined free with the new it knows
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void counted_free(void *p) noexcept
+{
+  std::free(p);
+}
+void *operator new(size_t size)
+{
+  if (void *p = counted_alloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size)
+{
+  if (void *p = counted_alloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size);
+}
+void operator delete(void *p) noexcept
+{
+  counted_free(p);
+}
+void operator delete[](void *p) noexcept
+{
+  counted_free(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+  counted_free(p);
+}
+void operator delete[](void *p, size_t) noexcept
+{
+  counted_free(p);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+  counted_free(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+  counted_free(p);
+}
+
 void test_unicode()
 {
   std::cout << "Running test: lexer test: test_unicode\n";
@@ -43,10 +110,1020 @@ void test_escape()
   CHECK_EQ(JSON(R"("\b\n\r\f\r\t")").to_string(), "\"\\b\\n\\r\\f\\r\\t\"");
 }
 
+void test_try_parse()
+{
+  std::cout << "Running test: parser test: test_try_parse\n";
+  JSON json;
+  JSON::Error err;
+  CHECK_EQ(JSON::try_parse(R"({"a": [1, true, "\u4f60"], "b": (3)$x$y$})", json, &err), JSON::ERR_NONE);
+  CHECK_EQ(json["a"][1].get_int(), 1);
+  CHECK_EQ(json["b"].get_raw().size(), 3);
+
+  CHECK_EQ(JSON::try_parse("{\n  \"a\": [1, 2,]\n}", json, &err), JSON::ERR_EXPECTED_VALUE);
+  CHECK_EQ(err.offset, 15);
+  CHECK_EQ(err.line, 2);
+  CHECK_EQ(err.column, 14);
+  // out is left untouched on failure
+  CHECK_EQ(json["a"][0].get_int(), 1);
+
+  CHECK_EQ(JSON::try_parse("", json), JSON::ERR_UNEXPECTED_END);
+  CHECK_EQ(JSON::try_parse("[1 2]", json), JSON::ERR_EXPECTED_COMMA);
+  CHECK_EQ(JSON::try_parse("{1: 2}", json), JSON::ERR_EXPECTED_KEY);
+  CHECK_EQ(JSON::try_parse("{\"a\" 2}", json), JSON::ERR_EXPECTED_COLON);
+  CHECK_EQ(JSON::try_parse("nil", json), JSON::ERR_BAD_WORD);
+  CHECK_EQ(JSON::try_parse("-1", json), JSON::ERR_UNEXPECTED_CHAR);
+  CHECK_EQ(JSON::try_parse("99999999999999999999", json), JSON::ERR_BAD_NUMBER);
+  // the plain constructor agrees, packed arrays included
+  for (auto text : {"99999999999999999999", "[1, 99999999999999999999]", "[{}, 99999999999999999999]"})
+  {
+    bool thrown = false;
+    try
+    {
+      JSON tmp(text);
+    }
+    catch (std::runtime_error &)
+    {
+      thrown = true;
+    }
+    CHECK_EQ(thrown, true);
+  }
+  CHECK_EQ(JSON("[9223372036854775807]").get_ints()[0], INT64_MAX);
+  CHECK_EQ(JSON::try_parse(R"("\x")", json), JSON::ERR_BAD_ESCAPE);
+  CHECK_EQ(JSON::try_parse(R"("\u12g4")", json), JSON::ERR_BAD_ESCAPE);
+  CHECK_EQ(JSON::try_parse("\"\xe4\"", json), JSON::ERR_BAD_UTF8);
+  CHECK_EQ(JSON::try_parse("(5)$ab$", json), JSON::ERR_UNEXPECTED_END);
+  CHECK_EQ(JSON::try_parse("(2)$ab#", json), JSON::ERR_BAD_RAW);
+  CHECK_EQ(JSON::try_parse("{} {}", json), JSON::ERR_TRAILING_CHARS);
+  CHECK_EQ(json.get_type(), JSON::GROUP);
+
+  std::string deep(10000, '[');
+  deep += std::string(10000, ']');
+  CHECK_EQ(JSON::try_parse(deep + "]", json), JSON::ERR_TRAILING_CHARS);
+  CHECK_EQ(JSON::try_parse("\"\xf0\x9f\x98\x80\"", json), JSON::ERR_NONE);
+  CHECK_EQ(json.get_str(), "\xf0\x9f\x98\x80");
+}
+
+void test_limits()
+{
+  std::cout << "Running test: parser test: test_limits\n";
+  // deep documents no longer recurse on the C++ stack
+  const size_t depth = 200000;
+  std::string deep = std::string(depth, '[') + "1" + std::string(depth, ']');
+  {
+    JSON json(deep);
+    std::string out = json.to_string("");
+    CHECK_EQ(std::count(out.begin(), out.end(), '['), depth);
+  }
+
+  JSON::ParseOptions opts;
+  opts.max_depth = 3;
+  JSON json;
+  JSON::Error err;
+  CHECK_EQ(JSON::try_parse("[[[1]]]", json, &err, opts), JSON::ERR_NONE);
+  CHECK_EQ(JSON::try_parse("[[[[1]]]]", json, &err, opts), JSON::ERR_TOO_DEEP);
+  CHECK_EQ(err.offset, 3);
+
+  opts = JSON::ParseOptions();
+  opts.max_nodes = 4;
+  CHECK_EQ(JSON::try_parse(R"({"a": 1, "b": [2]})", json, &err, opts), JSON::ERR_NONE);
+  CHECK_EQ(JSON::try_parse(R"({"a": 1, "b": [2, 3]})", json, &err, opts), JSON::ERR_TOO_MANY_NODES);
+
+  opts = JSON::ParseOptions();
+  opts.max_string_length = 3;
+  CHECK_EQ(JSON::try_parse(R"({"abc": "\u4f60"})", json, &err, opts), JSON::ERR_NONE);
+  CHECK_EQ(JSON::try_parse(R"({"abc": "\u4f60a"})", json, &err, opts), JSON::ERR_STRING_TOO_LONG);
+  CHECK_EQ(err.offset, 8);
+
+  opts = JSON::ParseOptions();
+  opts.max_raw_size = 2;
+  CHECK_EQ(JSON::try_parse("[(2)$ab$]", json, &err, opts), JSON::ERR_NONE);
+  CHECK_EQ(JSON::try_parse("[(3)$abc$]", json, &err, opts), JSON::ERR_RAW_TOO_LARGE);
+
+  bool thrown = false;
+  try
+  {
+    JSON bad("[(3)$abc$]", opts);
+  }
+  catch (std::runtime_error &e)
+  {
+    thrown = true;
+    CHECK_EQ(std::string(e.what()), "JSON: raw data too large at line 1, column 2");
+  }
+  CHECK_EQ(thrown, true);
+}
+
+void test_schema()
+{
+  std::cout << "Running test: parser test: test_schema\n";
+  JSON::Schema schema(R"({
+    "type": "object", "required": ["id", "name"], "additionalProperties": false,
+    "properties": {
+      "id": {"type": "integer", "minimum": 1, "maximum": 1000},
+      "name": {"type": "string", "minLength": 1, "maxLength": 4},
+      "tags": {"type": "array", "maxItems": 2, "items": {"type": ["string", "null"]}},
+      "blob": {"type": "raw", "maxLength": 2},
+      "extra": {"type": "object"},
+      "ok": {"type": "boolean"}
+    }
+  })");
+  JSON::ParseOptions opts;
+  opts.schema = &schema;
+  JSON json;
+  JSON::Error err;
+  auto check = [&](const std::string &text) { return JSON::try_parse(text, json, &err, opts); };
+  CHECK_EQ(check(R"({"id": 7, "name": "\u4f60abc", "tags": ["x", null], "blob": (2)$ab$,
+                     "extra": {"any": [1, {"b": 2}]}, "ok": true})"), JSON::ERR_NONE);
+  CHECK_EQ(json["name"].get_str(), "\u4f60abc");
+  // the offset is where the document first breaks the schema
+  CHECK_EQ(check(R"({"id": "7", "name": "a"})"), JSON::ERR_SCHEMA_TYPE);
+  CHECK_EQ(err.offset, 7);
+  CHECK_EQ(check(R"({"id": 1001, "name": "a"})"), JSON::ERR_SCHEMA_RANGE);
+  CHECK_EQ(check(R"({"id": 1, "name": "abcde"})"), JSON::ERR_SCHEMA_RANGE);
+  CHECK_EQ(check(R"({"id": 1, "name": ""})"), JSON::ERR_SCHEMA_RANGE);
+  CHECK_EQ(check(R"({"id": 1, "name": "a", "tags": ["x", 2]})"), JSON::ERR_SCHEMA_TYPE);
+  CHECK_EQ(check(R"({"id": 1, "name": "a", "tags": ["x", "y", "z"]})"), JSON::ERR_SCHEMA_RANGE);
+  CHECK_EQ(err.offset, 42);
+  CHECK_EQ(check(R"({"id": 1, "name": "a", "blob": (3)$abc$})"), JSON::ERR_SCHEMA_RANGE);
+  CHECK_EQ(check(R"({"id": 1, "name": "a", "ok": 1})"), JSON::ERR_SCHEMA_TYPE);
+  CHECK_EQ(check(R"({"id": 1, "nam\u0065": "a"})"), JSON::ERR_NONE);
+  CHECK_EQ(check(R"({"id": 1, "nick": "a"})"), JSON::ERR_SCHEMA_UNKNOWN_KEY);
+  CHECK_EQ(err.offset, 10);
+  CHECK_EQ(check(R"({"id": 1, "tags": []})"), JSON::ERR_SCHEMA_REQUIRED);
+  CHECK_EQ(err.offset, 20);
+  CHECK_EQ(check("[]"), JSON::ERR_SCHEMA_TYPE);
+
+  bool thrown = false;
+  try
+  {
+    JSON::Schema bad(R"({"type": "float"})");
+  }
+  catch (const std::runtime_error &)
+  {
+    thrown = true;
+  }
+  CHECK_EQ(thrown, true);
+}
+void test_group()
+{
+  std::cout << "Running test: node test: test_group\n";
+  JSON json(R"({"b": 2, "a": 1, "c": {"y": 3, "x": 4}, "a": 5})");
+  CHECK_EQ(json.count(), 3);
+  // duplicated keys keep the first value
+  CHECK_EQ(json["a"].get_int(), 1);
+  CHECK_EQ(json["c"]["x"].get_int(), 4);
+  json.add_pair("aa", JSON::val(6));
+  json.add_pair("b", JSON::val(7));
+  CHECK_EQ(json["b"].get_int(), 2);
+  std::string keys;
+  for (auto &it : json.get_map())
+    keys += it.first;
+  CHECK_EQ(keys, "aaabc");
+  CHECK_EQ(json["c"].to_string(""), "{\n\"x\": 4,\n\"y\": 3\n}");
+}
+
+void test_packed_array()
+{
+  std::cout << "Running test: node test: test_packed_array\n";
+  JSON json(R"({"ids": [3, 1,
+    4, 1, 5], "mixed": [1, "a"]})");
+  JSON ids = json["ids"];
+  CHECK_EQ(ids.is_packed(), true);
+  CHECK_EQ(json["mixed"].is_packed(), false);
+  auto span = ids.get_ints();
+  CHECK_EQ(span.size(), 5);
+  int64_t sum = 0;
+  for (auto v : span)
+    sum += v;
+  CHECK_EQ(sum, 14);
+  CHECK_EQ(ids.to_string(" "), "[\n 3,\n 1,\n 4,\n 1,\n 5\n]");
+
+  // element handles need nodes
+  CHECK_EQ(ids[2].get_int(), 4);
+  CHECK_EQ(ids.is_packed(), false);
+  CHECK_EQ(ids.length(), 5);
+  // a pushed handle still refers to the element
+  JSON small("[1, 2, 3]");
+  JSON seven = JSON::val(7);
+  small.push(seven);
+  CHECK_EQ(small.is_packed(), false);
+  CHECK_EQ(seven.get_int(), 7);
+  seven.get_int() = 8;
+  CHECK_EQ(small[3].get_int(), 8);
+  JSON five = JSON::val(5);
+  JSON other("[1, 2, 3]");
+  other.set(1, five);
+  CHECK_EQ(five.get_int(), 5);
+  five.get_int() = 6;
+  CHECK_EQ(other[1].get_int(), 6);
+  // null has no packed form
+  JSON nums("[1, 2]");
+  nums.push(JSON("null"));
+  CHECK_EQ(nums.is_packed(), false);
+  CHECK_EQ(nums[2].is_null(), true);
+  CHECK_EQ(JSON("[[1, 2], [3]]").to_string(""), "[\n[\n1,\n2\n],\n[\n3\n]\n]");
+}
+
+void test_projection()
+{
+  std::cout << "Running test: parser test: test_projection\n";
+  std::string text = R"({
+    "user": {"id": 7, "name": "x", "tags": ["a", {"b": "}]\""}]},
+    "items": [{"price": 1, "blob": (3)$}]{$}, {"price": 2}, {"name": "none"}],
+    "a/b": {"c~d": "escaped"},
+    "skip": [[[{"deep": true}]], "text with ] and }"]
+  })";
+  JSON::Projection proj({"/user/id", "/items/*/price", "/a~1b/c~0d", "/missing/x"});
+  JSON json(text, proj);
+  CHECK_EQ(json.count(), 3);
+  CHECK_EQ(json["user"].count(), 1);
+  CHECK_EQ(json["user"]["id"].get_int(), 7);
+  CHECK_EQ(json["items"].length(), 3);
+  CHECK_EQ(json["items"][1]["price"].get_int(), 2);
+  CHECK_EQ(json["items"][2].count(), 0);
+  CHECK_EQ(json["a/b"]["c~d"].get_str(), "escaped");
+
+  // the selected element keeps its index
+  JSON second(text, JSON::Projection({"/items/1", "/user/tags"}));
+  CHECK_EQ(second["items"].length(), 2);
+  CHECK_EQ(second["items"][0].is_null(), true);
+  CHECK_EQ(second["items"][1]["price"].get_int(), 2);
+  JSON item;
+  CHECK_EQ(second.find(JSON::Pointer("/items/1/price"), item), true);
+  CHECK_EQ(second["user"]["tags"][1]["b"].get_str(), "}]\"");
+
+  // a "*" step and a specific one select both subtrees
+  std::string rows = R"({"a": [{"x": 1, "y": 2}, {"x": 3, "y": 4}], "m": {"k": {"x": 5, "y": 6}, "j": {"x": 7}}})";
+  JSON both(rows, JSON::Projection({"/a/*/x", "/a/0/y", "/m/*/x", "/m/k/y"}));
+  CHECK_EQ(both == JSON(R"({"a": [{"x": 1, "y": 2}, {"x": 3}], "m": {"k": {"x": 5, "y": 6}, "j": {"x": 7}}})"), true);
+
+  JSON whole(text, JSON::Projection({""}));
+  CHECK_EQ(whole.to_string(), JSON(text).to_string());
+}
+
+void test_pointer()
+{
+  std::cout << "Running test: node test: test_pointer\n";
+  JSON::Pointer port("/servers/1/port");
+  JSON::Pointer odd("/a~1b/~0");
+  JSON out;
+  for (int k = 0; k < 3; k++)
+  {
+    JSON json(R"({"servers": [{"port": 80}, {"host": "h", "port": )" + std::to_string(8000 + k) + R"(}], "a/b": {"~": "t"}})");
+    CHECK_EQ(json.find(port, out), true);
+    CHECK_EQ(out.get_int(), 8000 + k);
+    CHECK_EQ(json.at(odd).get_str(), "t");
+  }
+  JSON json(R"({"servers": [{"port": 80}], "ids": [1, 2]})");
+  // reading through a view leaves a packed array packed
+  JSON::View seen;
+  CHECK_EQ(json.find(JSON::Pointer("/ids/1"), seen), true);
+  CHECK_EQ(seen.get_int(), 2);
+  CHECK_EQ(json.find(JSON::Pointer("/ids/2"), seen), false);
+  json.apply_patch(JSON(R"([{"op": "test", "path": "/ids/0", "value": 1}, {"op": "copy", "from": "/ids/1", "path": "/two"}])"));
+  CHECK_EQ(json["ids"].is_packed(), true);
+  CHECK_EQ(json["two"].get_int(), 2);
+  json.erase("two");
+  CHECK_EQ(json.find(port, out), false);
+  CHECK_EQ(json.find(JSON::Pointer("/servers/01/port"), out), false);
+  CHECK_EQ(json.find(JSON::Pointer("/servers/0/port/x"), out), false);
+  CHECK_EQ(json.find(JSON::Pointer("/ids/1"), out), true);
+  CHECK_EQ(out.get_int(), 2);
+  CHECK_EQ(json.find(JSON::Pointer(""), out), true);
+  CHECK_EQ(out.count(), 2);
+  bool thrown = false;
+  try
+  {
+    json.at(JSON::Pointer("/nope"));
+  }
+  catch (std::runtime_error &)
+  {
+    thrown = true;
+  }
+  CHECK_EQ(thrown, true);
+}
+
+void test_patch()
+{
+  std::cout << "Running test: node test: test_patch\n";
+  JSON json(R"({"a": {"b": 1, "c": [1, 2, 3]}, "d": "x", "e": null})");
+  CHECK_EQ(json["e"].is_null(), true);
+  CHECK_EQ(json["a"]["b"].is_null(), false);
+  json.set("d", JSON::val("y"));
+  json["a"]["c"].set(1, JSON::val(7));
+  CHECK_EQ(json["a"]["c"].is_packed(), false);
+  CHECK_EQ(json["a"].erase("b"), true);
+  CHECK_EQ(json["a"].erase("b"), false);
+  json["a"]["c"].insert(0, JSON::val(0));
+  json["a"]["c"].erase(3);
+  JSON moved = json.detach(JSON::Pointer("/a/c"));
+  json.set("c", moved);
+  CHECK_EQ(json.to_string(""), "{\n\"a\": {\n},\n\"c\": [\n0,\n1,\n7\n],\n\"d\": \"y\",\n\"e\": null\n}");
+
+  // the examples of RFC 6902 appendix A
+  JSON doc(R"({"foo": ["bar", "baz"], "baz": {"qux": "hello"}, "ids": [1, 2, 3]})");
+  doc.apply_patch(JSON(R"([
+    {"op": "add", "path": "/foo/1", "value": "qux"},
+    {"op": "add", "path": "/foo/-", "value": {"deep": [4]}},
+    {"op": "remove", "path": "/foo/0"},
+    {"op": "replace", "path": "/baz/qux", "value": "world"},
+    {"op": "move", "from": "/baz/qux", "path": "/moved"},
+    {"op": "copy", "from": "/foo/2", "path": "/baz/copy"},
+    {"op": "test", "path": "/baz/copy/deep", "value": [4]},
+    {"op": "replace", "path": "/ids/1", "value": 20},
+    {"op": "remove", "path": "/ids/0"}
+  ])"));
+  CHECK_EQ(doc["foo"].length(), 3);
+  CHECK_EQ(doc["foo"][0].get_str(), "qux");
+  CHECK_EQ(doc["moved"].get_str(), "world");
+  CHECK_EQ(doc["baz"].count(), 1);
+  CHECK_EQ(doc["baz"]["copy"]["deep"][0].get_int(), 4);
+  CHECK_EQ(doc["foo"][2]["deep"][0].get_int(), 4);
+  CHECK_EQ(doc["ids"].is_packed(), true);
+  CHECK_EQ(doc["ids"].get_ints()[0], 20);
+
+  const char *bad[] = {
+      R"([{"op": "test", "path": "/moved", "value": "other"}])",
+      R"([{"op": "remove", "path": "/nope"}])",
+      R"([{"op": "add", "path": "/foo/9", "value": 1}])",
+      R"([{"op": "move", "from": "/baz", "path": "/baz/in"}])",
+      R"([{"op": "jump", "path": "/foo"}])",
+  };
+  for (auto text : bad)
+  {
+    bool thrown = false;
+    try
+    {
+      doc.apply_patch(JSON(text));
+    }
+    catch (std::runtime_error &)
+    {
+      thrown = true;
+    }
+    CHECK_EQ(thrown, true);
+  }
+
+  // a patch held by another document is copied from, not moved out of
+  JSON holder(R"({"ops": [{"op": "add", "path": "/b", "value": {"c": [1, 2]}}]})");
+  JSON small(R"({"a": 1})");
+  small.apply_patch(holder["ops"]);
+  CHECK_EQ(small["b"]["c"].length(), 2);
+  CHECK_EQ(holder == JSON(R"({"ops": [{"op": "add", "path": "/b", "value": {"c": [1, 2]}}]})"), true);
+  // so is a patch held in a variable
+  JSON ops(R"([{"op": "replace", "path": "/a", "value": [3]}])");
+  small.apply_patch(ops);
+  small.apply_patch(ops);
+  CHECK_EQ(ops.length(), 1);
+  CHECK_EQ(ops[size_t(0)]["value"][size_t(0)].get_int(), 3);
+  CHECK_EQ(small["a"][size_t(0)].get_int(), 3);
+  JSON merge(R"({"m": {"n": 1}})");
+  small.merge_patch(merge);
+  CHECK_EQ(merge["m"]["n"].get_int(), 1);
+  CHECK_EQ(small["m"]["n"].get_int(), 1);
+  // a move that cannot be linked leaves its source in place
+  bool failed = false;
+  try
+  {
+    small.apply_patch(JSON(R"([{"op": "move", "from": "/b", "path": "/nope/x"}])"));
+  }
+  catch (std::runtime_error &)
+  {
+    failed = true;
+  }
+  CHECK_EQ(failed, true);
+  CHECK_EQ(small["b"]["c"].length(), 2);
+
+  // RFC 7396 section 3
+  JSON target(R"({"title": "Goodbye!", "author": {"givenName": "John", "familyName": "Doe"},
+                  "tags": ["example", "sample"], "content": "This will be unchanged"})");
+  target.merge_patch(JSON(R"({"title": "Hello!", "phoneNumber": "+01-555-1234",
+                              "author": {"familyName": null}, "tags": ["example"], "n": {"x": null, "y": 1}})"));
+  CHECK_EQ(target["title"].get_str(), "Hello!");
+  CHECK_EQ(target["author"].count(), 1);
+  CHECK_EQ(target["author"]["givenName"].get_str(), "John");
+  CHECK_EQ(target["tags"].length(), 1);
+  CHECK_EQ(target["n"].count(), 1);
+  CHECK_EQ(target["content"].get_str(), "This will be unchanged");
+  target.merge_patch(JSON(R"(["whole"])"));
+  CHECK_EQ(target[size_t(0)].get_str(), "whole");
+}
+
+void test_cached_output()
+{
+  std::cout << "Running test: node test: test_cached_output\n";
+  JSON json(R"({"a": {"b": [1, 2, 3], "c": {"d": "x", "e": [{"f": 1}, "g"]}}, "h": (3)$raw$, "i": [4, 5]})");
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+
+  json["a"]["c"]["e"][0]["f"].get_int() = 7;
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+  json["a"]["b"].get_ints()[1] = 9;
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+  // unpacking keeps the array clean, the element still reports its change
+  json["i"][1].get_int() = 6;
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+  json["a"]["c"].add_pair("new", JSON::val("n"));
+  json["a"]["c"]["e"].push(JSON::val(3));
+  json["a"]["c"]["d"].get_str() = "y";
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+  json.apply_patch(JSON(R"([{"op": "move", "from": "/a/c/e", "path": "/e"}, {"op": "remove", "path": "/h"}])"));
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+  // another indent or a subtree written at another depth does not reuse the cache
+  CHECK_EQ(json.to_string_cached("\t"), json.to_string("\t"));
+  CHECK_EQ(json["a"].to_string_cached(), json["a"].to_string());
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+#ifdef JSON_LITE_STATS
+  json["e"][0]["f"].get_int() = 8;
+  json.to_string_cached();
+  // the root, "a" spliced, "e" and its first element rewritten, "f", "g", 3
+  CHECK_EQ(JSON::last_stats().nodes[JSON::GROUP], 3);
+#endif
+  json.drop_cache();
+  CHECK_EQ(json.to_string_cached(), json.to_string());
+}
+
+void test_hash_diff()
+{
+  std::cout << "Running test: node test: test_hash_diff\n";
+  JSON a(R"({"x": 1, "y": [1, 2], "z": {"s": "t"}})");
+  JSON b(R"({"z": {"s": "t"}, "y": [1, 2], "x": 1})");
+  CHECK_EQ(a.hash(), b.hash());
+  CHECK_EQ(a == b, true);
+  JSON unpacked = JSON::array({JSON::val(1), JSON::val(2)});
+  CHECK_EQ(a["y"] == unpacked, true);
+  CHECK_EQ(a["y"].hash(), unpacked.hash());
+  CHECK_EQ(JSON("[null]") == JSON("[0]"), false);
+  CHECK_EQ(JSON("\"1\"") == JSON("1"), false);
+
+  uint64_t before = a.hash();
+  a["z"]["s"].get_str() = "u";
+  CHECK_EQ(a != b, true);
+  CHECK_NE(a.hash(), before);
+  a["z"]["s"].get_str() = "t";
+  CHECK_EQ(a.hash(), before);
+  a["y"].push(JSON::val(3));
+  CHECK_EQ(a == b, false);
+
+  const char *pairs[][2] = {
+      {R"({"a": 1, "b": {"c": [1, 2, 3], "d/e": "x"}, "f": [{"g": 1}, 2]})",
+       R"({"a": 1, "b": {"c": [1, 5], "d/e": "y", "~": 0}, "f": [{"g": 2}, 2, "h", [3]]})"},
+      {R"({"keep": [1, 2, 3], "drop": (2)$ab$, "n": null})", R"({"keep": [1, 2, 3], "n": {"m": [4]}})"},
+      {R"([1, "a", {"b": 1}])", R"([2])"},
+      {R"({"a": 1})", R"(["whole"])"},
+  };
+  for (auto &p : pairs)
+  {
+    JSON from(p[0]), to(p[1]);
+    JSON patch = JSON::diff(from, to);
+    from.apply_patch(patch);
+    CHECK_EQ(from == to, true);
+  }
+  JSON same(pairs[0][0]);
+  CHECK_EQ(JSON::diff(same, JSON(pairs[0][0])).length(), 0);
+  JSON one = JSON::diff(JSON(pairs[1][0]), JSON(pairs[1][1]));
+  CHECK_EQ(one.length(), 2);
+  // a packed array against nodes is read in place, spans stay valid
+  JSON packed("[1, 2, 3]"), mixed(R"([1, "x", 3, 4])");
+  auto span = packed.get_ints();
+  JSON there = JSON::diff(packed, mixed), back = JSON::diff(mixed, packed);
+  CHECK_EQ(packed.is_packed(), true);
+  CHECK_EQ(span[0], 1);
+  CHECK_EQ(there.length(), 2);
+  CHECK_EQ(back.length(), 2);
+  packed.apply_patch(there);
+  CHECK_EQ(packed == mixed, true);
+  mixed.apply_patch(back);
+  CHECK_EQ(mixed == JSON("[1, 2, 3]"), true);
+}
+
+void test_snapshot()
+{
+  std::cout << "Running test: node test: test_snapshot\n";
+  JSON json(R"({"ids": [1, 2, 3], "name": "n", "nested": {"a": [{"b": null}]}})");
+  JSON::Snapshot snap(json);
+  JSON::View root = snap.root();
+  CHECK_EQ(root["ids"][1].get_int(), 2);
+  CHECK_EQ(root["ids"].get_list().size(), 3);
+  CHECK_EQ(root["name"].get_str(), "n");
+  CHECK_EQ(root["nested"]["a"][0]["b"].is_null(), true);
+  JSON::View out;
+  CHECK_EQ(root.find(JSON::Pointer("/ids/2"), out), true);
+  CHECK_EQ(out.get_int(), 3);
+  CHECK_EQ(root == JSON::Snapshot(root.to_string()).root(), true);
+  JSON copy = root.clone();
+  copy["name"].get_str() = "m";
+  CHECK_EQ(root["name"].get_str(), "n");
+  // the snapshot does not share its tree with the handle it was made from
+  json["name"].get_str() = "mutated";
+  CHECK_EQ(root["name"].get_str(), "n");
+  JSON owned(R"({"k": "v"})");
+  {
+    JSON::Snapshot taken(std::move(owned));
+    CHECK_EQ(taken.root()["k"].get_str(), "v");
+  }
+  CHECK_EQ(owned.count(), 0);
+  CHECK_EQ(json["name"].get_str(), "mutated");
+
+  auto make = [](int version) {
+    return std::make_shared<const JSON::Snapshot>(R"({"version": )" + std::to_string(version) +
+                                                  R"(, "same": )" + std::to_string(version) + "}");
+  };
+  JSON::Publisher pub(make(0));
+  std::atomic<bool> done(false);
+  std::atomic<int> torn(0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++)
+  {
+    readers.emplace_back([&]() {
+      int last = 0;
+      while (!done)
+      {
+        auto cur = pub.get();
+        int version = int(cur->root()["version"].get_int());
+        if (version != cur->root()["same"].get_int() || version < last)
+          torn++;
+        last = version;
+      }
+    });
+  }
+  for (int k = 1; k <= 200; k++)
+    pub.publish(make(k));
+  done = true;
+  for (auto &t : readers)
+    t.join();
+  CHECK_EQ(torn.load(), 0);
+  CHECK_EQ(pub.get()->root()["version"].get_int(), 200);
+}
+
+struct BindEndpoint
+{
+  std::string host;
+  int port = 0;
+};
+JSON_BIND(BindEndpoint, host, port)
+struct BindConfig
+{
+  int64_t id = 0;
+  std::string name;
+  std::vector<int64_t> ids;
+  std::vector<BindEndpoint> endpoints;
+  BindEndpoint primary;
+  std::vector<unsigned char> blob;
+  bool enabled = false;
+};
+JSON_BIND(BindConfig, id, name, ids, endpoints, primary, blob, enabled)
+struct BindNarrow
+{
+  uint8_t small = 0;
+  int port = 0;
+};
+JSON_BIND(BindNarrow, small, port)
+
+void test_context()
+{
+  std::cout << "Running test: node test: test_context\n";
+  const std::string doc = R"({"id": 7, "name": "a value longer than any small string buffer",
+    "tags": ["first tag long enough to need the heap", "second"], "blob": (4)$abcd$,
+    "ids": [1, 2, 3, 4, 5, 6, 7, 8], "nested": {"ok": true, "none": null, "list": [{"k": 1}, {}, []]},
+    "zkey": 1, "akey": 2})";
+  JSON::Context ctx;
+  for (int round = 0; round < 3; round++)
+  {
+    ctx.parse(doc);
+    ctx.parse(doc);
+    ctx.reset();
+  }
+  size_t before = allocations;
+  JSON first = ctx.parse(doc);
+  JSON second = ctx.parse(doc);
+  ctx.reset();
+  JSON json = ctx.parse(doc);
+  CHECK_EQ(allocations - before, 0);
+  CHECK_EQ(json["name"].get_str(), "a value longer than any small string buffer");
+  CHECK_EQ(json["tags"][0].get_str(), "first tag long enough to need the heap");
+  CHECK_EQ(json["ids"].get_ints()[7], 8);
+  CHECK_EQ(json["blob"].get_raw().size(), 4);
+  CHECK_EQ(json["nested"]["none"].is_null(), true);
+  CHECK_EQ(json["nested"]["list"].length(), 3);
+  CHECK_EQ(json == JSON(doc), true);
+  CHECK_EQ(json.to_string(), JSON(doc).to_string());
+  ctx.reset();
+  JSON other = ctx.parse(R"({"b": [1, {"c": 2}], "a": "x"})");
+  CHECK_EQ(other["b"][1]["c"].get_int(), 2);
+  CHECK_EQ(other.to_string(""), JSON(R"({"a": "x", "b": [1, {"c": 2}]})").to_string(""));
+  try
+  {
+    ctx.parse(R"({"a": [1, 2)");
+    CHECK_EQ("no exception", "exception");
+  }
+  catch (const std::runtime_error &)
+  {
+  }
+  CHECK_EQ(ctx.parse("[3]")[0].get_int(), 3);
+}
+
+void test_stream()
+{
+  std::cout << "Running test: io test: test_stream\n";
+  // tokens of every kind land on chunk boundaries, some span several chunks
+  JSON json = JSON::map({{"long", JSON::val(std::string(200000, 'x') + "\"\\")}});
+  std::vector<JSON> items;
+  for (int i = 0; i < 5000; i++)
+    items.push_back(JSON::map({{"id", JSON::val(i)}, {"name", JSON::val("item \u4f60 " + std::to_string(i))},
+                               {"blob", JSON::raw(std::vector<unsigned char>(i % 7, '$'))}}));
+  json.add_pair("items", JSON::array(items));
+  std::string ints = "[";
+  for (int i = 0; i < 30000; i++)
+    ints += (i ? ", " : "") + std::to_string(i * 7919);
+  json.add_pair("ints", JSON(ints + "]"));
+  json.add_pair("flags", JSON(R"([true, false, null])"));
+
+  std::stringstream plain;
+  json.write_to(plain);
+  CHECK_EQ(plain.str().find("(raw-data:"), std::string::npos);
+  JSON back = JSON::read_from(plain);
+  CHECK_EQ(back == json, true);
+  CHECK_EQ(back["ints"].is_packed(), true);
+  CHECK_EQ(back["items"][4999]["blob"].get_raw().size(), 4999 % 7);
+  CHECK_EQ(back["flags"][2].is_null(), true);
+
+  std::stringstream gz;
+#ifdef JSON_LITE_ZLIB
+  json.write_to(gz, JSON::GZIP, "");
+  CHECK_EQ(gz.str().size() < plain.str().size() / 4, true);
+  CHECK_EQ(JSON::read_from(gz) == json, true);
+  // concatenated members read as one text, the value after the first is ignored
+  std::stringstream parts;
+  JSON::val("ab").write_to(parts, JSON::GZIP);
+  std::stringstream joined(parts.str() + parts.str());
+  CHECK_EQ(JSON::read_from(joined).get_str(), "ab");
+  std::stringstream cut(gz.str().substr(0, gz.str().size() / 2));
+  try
+  {
+    JSON::read_from(cut);
+    CHECK_EQ("no exception", "exception");
+  }
+  catch (const std::runtime_error &)
+  {
+  }
+#else
+  gz.str("\x1f\x8b\x08");
+  try
+  {
+    JSON::read_from(gz);
+    CHECK_EQ("no exception", "exception");
+  }
+  catch (const std::runtime_error &e)
+  {
+    CHECK_NE(std::string(e.what()).find("JSON_LITE_ZLIB"), std::string::npos);
+  }
+#endif
+}
+
+void test_columns()
+{
+  std::cout << "Running test: node test: test_columns\n";
+  const std::string text = R"([
+    {"id": 1, "name": "a", "blob": (2)$xy$, "score": 10},
+    {"score": 20, "name": "b\u4f60", "id": 2},
+    {"id": null, "name": 3, "extra": {"id": 9}},
+    7,
+    {"id": 4, "id": 5, "name": "", "score": true}
+  ])";
+  auto make = []() {
+    std::vector<JSON::Column> cols;
+    cols.emplace_back("id", JSON::INT);
+    cols.emplace_back("name", JSON::STRING);
+    cols.emplace_back("blob", JSON::RAW);
+    cols.emplace_back("score", JSON::INT);
+    return cols;
+  };
+  std::vector<JSON::Column> from_tree = make(), from_text = make();
+  JSON(text).get_columns(from_tree);
+  JSON::read_columns(text, from_text);
+  for (auto *cols : {&from_tree, &from_text})
+  {
+    auto &id = (*cols)[0], &name = (*cols)[1], &blob = (*cols)[2], &score = (*cols)[3];
+    CHECK_EQ(id.rows, 5);
+    CHECK_EQ(id.ints.size(), 5);
+    CHECK_EQ(id.ints[1], 2);
+    CHECK_EQ(id.ints[4], 4);
+    CHECK_EQ(id.is_null(2), true);
+    CHECK_EQ(id.is_missing(2), false);
+    CHECK_EQ(id.is_missing(3), true);
+    CHECK_EQ(name.get_str(1).str(), "b\u4f60");
+    CHECK_EQ(name.is_missing(2), true);
+    CHECK_EQ(name.get_str(4).size(), 0);
+    CHECK_EQ(name.is_missing(4), false);
+    CHECK_EQ(blob.get_str(0).str(), "xy");
+    CHECK_EQ(blob.is_missing(1), true);
+    CHECK_EQ(score.ints[1], 20);
+    CHECK_EQ(score.ints[4], 1);
+  }
+  from_text[1].clear();
+  CHECK_EQ(from_text[1].rows, 0);
+  CHECK_EQ(from_text[1].offsets.size(), 1);
+}
+
+void test_index()
+{
+  std::cout << "Running test: node test: test_index\n";
+  JSON::ParseOptions opts;
+  opts.indexes.push_back({"/routes", "/host"});
+  opts.indexes.push_back({"/missing", "/host"});
+  JSON json(R"({"routes": [
+    {"id": 1, "host": "a.example", "up": {"port": 80}},
+    {"id": 2, "host": "b.example", "up": {"port": 81}},
+    {"id": 3, "up": {"port": 82}},
+    7
+  ]})", opts);
+  JSON routes = json["routes"], out;
+  CHECK_EQ(routes.find_by("/host", "b.example", out), true);
+  CHECK_EQ(out["id"].get_int(), 2);
+  CHECK_EQ(routes.find_by("/host", "c.example", out), false);
+  CHECK_EQ(out["id"].get_int(), 2);
+  // built on first use, the key type must match too
+  CHECK_EQ(routes.find_by("/up/port", 82, out), true);
+  CHECK_EQ(out["id"].get_int(), 3);
+  CHECK_EQ(routes.find_by("/id", "1", out), false);
+
+  // pushed, replaced and erased elements are keyed at once
+  routes.push(JSON(R"({"id": 4, "host": "d.example"})"));
+  CHECK_EQ(routes.find_by("/host", "d.example", out), true);
+  CHECK_EQ(out["id"].get_int(), 4);
+  routes.set(1, JSON(R"({"id": 5, "host": "e.example"})"));
+  CHECK_EQ(routes.find_by("/host", "b.example", out), false);
+  CHECK_EQ(routes.find_by("/host", "e.example", out), true);
+  routes.erase(size_t(0));
+  CHECK_EQ(routes.find_by("/host", "a.example", out), false);
+
+  // edits inside an element, through the references and the handle
+  routes[0]["host"].get_str() = "f.example";
+  CHECK_EQ(routes.find_by("/host", "e.example", out), false);
+  CHECK_EQ(routes.find_by("/host", "f.example", out), true);
+  CHECK_EQ(out["id"].get_int(), 5);
+  routes[1]["up"]["port"].get_int() = 90;
+  routes[1].set("host", JSON::val("g.example"));
+  CHECK_EQ(routes.find_by("/up/port", 82, out), false);
+  CHECK_EQ(routes.find_by("/up/port", 90, out), true);
+  CHECK_EQ(routes.find_by("/host", "g.example", out), true);
+  CHECK_EQ(out["id"].get_int(), 3);
+  json.detach(JSON::Pointer("/routes/1/host"));
+  CHECK_EQ(routes.find_by("/host", "g.example", out), false);
+
+  // a moved element leaves the index of its old array
+  JSON moved = json.detach(JSON::Pointer("/routes/0"));
+  moved["host"].get_str() = "h.example";
+  CHECK_EQ(routes.find_by("/host", "f.example", out), false);
+  CHECK_EQ(routes.find_by("/host", "h.example", out), false);
+  CHECK_EQ(routes.length(), 3);
+
+  CHECK_EQ(routes.drop_index("/host"), true);
+  CHECK_EQ(routes.drop_index("/host"), false);
+  CHECK_EQ(routes.find_by("/host", "d.example", out), true);
+  CHECK_EQ(out["id"].get_int(), 4);
+  CHECK_EQ(json == JSON(R"({"routes": [{"id": 3, "up": {"port": 90}}, 7, {"host": "d.example", "id": 4}]})"), true);
+
+  // duplicated keys, any of them is found
+  JSON dup(R"([{"k": 1, "v": "x"}, {"k": 1, "v": "y"}])");
+  CHECK_EQ(dup.find_by("/k", 1, out), true);
+  CHECK_EQ(out["k"].get_int(), 1);
+}
+
+void test_base64()
+{
+  std::cout << "Running test: io test: test_base64\n";
+  const std::string uri = "data:application/octet-stream;base64,";
+  CHECK_EQ(JSON::raw({'a', 'b'}).to_string("", JSON::RAW_BASE64), "\"" + uri + "YWI=\"");
+  JSON::ParseOptions opts;
+  opts.decode_base64 = true;
+  // every length up to a few blocks, so each kernel ends on every tail
+  std::vector<JSON> blobs;
+  for (int n = 0; n < 100; n++)
+  {
+    std::vector<unsigned char> v(n);
+    for (int k = 0; k < n; k++)
+      v[k] = (unsigned char)(k * 37 + n);
+    blobs.push_back(JSON::raw(v));
+  }
+  JSON json = JSON::map({{"blobs", JSON::array(blobs)}, {"name", JSON::val("data:text/plain;base64,YWI=")}});
+  std::string text = json.to_string("", JSON::RAW_BASE64);
+  CHECK_EQ(text.find('$'), std::string::npos);
+  JSON back(text, opts);
+  CHECK_EQ(back == json, true);
+  CHECK_EQ(back["name"].get_type(), JSON::STRING);
+  // without the option the strings stay strings
+  CHECK_EQ(JSON(text)["blobs"][3].get_str(), "data:application/octet-stream;base64,AyhN");
+  std::stringstream out;
+  json.write_to(out, JSON::PLAIN, "  ", JSON::RAW_BASE64);
+  CHECK_EQ(JSON(out.str(), opts) == json, true);
+
+  JSON::Error err;
+  CHECK_EQ(JSON::try_parse("[\"" + uri + "YW*=\"]", back, &err, opts), JSON::ERR_BAD_BASE64);
+  CHECK_EQ(err.offset, 2 + uri.size() + 2);
+  CHECK_EQ(JSON::try_parse("[\"" + uri + "YWI\"]", back, &err, opts), JSON::ERR_BAD_BASE64);
+  CHECK_EQ(JSON::try_parse("[\"" + uri + "Y=I=\"]", back, &err, opts), JSON::ERR_BAD_BASE64);
+  opts.max_raw_size = 2;
+  CHECK_EQ(JSON::try_parse("[\"" + uri + "YWI=\"]", back, &err, opts), JSON::ERR_NONE);
+  CHECK_EQ(JSON::try_parse("[\"" + uri + "YWJj\"]", back, &err, opts), JSON::ERR_RAW_TOO_LARGE);
+}
+#ifdef JSON_LITE_PMR
+// counts what is taken and given back through it
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+  size_t outstanding = 0;
+  size_t allocations = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override
+  {
+    outstanding += bytes;
+    allocations++;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t align) override
+  {
+    outstanding -= bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+  {
+    return this == &other;
+  }
+};
+void test_resource()
+{
+  std::cout << "Running test: node test: test_resource\n";
+  CountingResource res;
+  {
+    JSON json = [&res]() {
+      JSON::ResourceScope scope(&res);
+      JSON doc(R"({"name": "a string longer than the small buffer", "ids": [1, 2, 3], "raw": (2)$ab$})");
+      doc.add_pair("more", JSON::map({{"k", JSON::val("another string longer than the small buffer")}}));
+      return doc;
+    }();
+    size_t before = res.allocations;
+    CHECK_NE(before, 0);
+    // unpacked integers come from the resource of their array
+    CHECK_EQ(json["ids"][1].get_int(), 2);
+    CHECK_EQ(res.allocations > before, true);
+    before = res.allocations;
+    // edits outside a scope take the default resource, the tree may mix them
+    json.set("name", JSON::val("from the default resource, longer than the buffer"));
+    CHECK_EQ(res.allocations, before);
+    CHECK_EQ(json["more"]["k"].get_str(), "another string longer than the small buffer");
+    CHECK_EQ(json["raw"].get_raw().size(), 2);
+  }
+  CHECK_EQ(res.outstanding, 0);
+}
+#endif
+
+void test_bind()
+{
+  std::cout << "Running test: bind test: test_bind\n";
+  BindConfig cfg;
+  JSONBind::read(R"({
+    "id": 42, "name": "a\tb\u4f60", "unknown": {"x": [1, "]", {"y": (2)$}{$}]},
+    "ids": [1, 2, 3], "endpoints": [{"host": "h1", "port": 80}, {"port": 81, "extra": null}],
+    "primary": {"host": "p"}, "blob": (3)$a$b$, "enabled": true
+  })", cfg);
+  CHECK_EQ(cfg.id, 42);
+  CHECK_EQ(cfg.name, "a\tb\u4f60");
+  CHECK_EQ(cfg.ids.size(), 3);
+  CHECK_EQ(cfg.endpoints.size(), 2);
+  CHECK_EQ(cfg.endpoints[0].host, "h1");
+  CHECK_EQ(cfg.endpoints[1].port, 81);
+  CHECK_EQ(cfg.primary.host, "p");
+  CHECK_EQ(std::string(cfg.blob.begin(), cfg.blob.end()), "a$b");
+  CHECK_EQ(cfg.enabled, true);
+
+  std::string out = JSONBind::write(cfg);
+  CHECK_EQ(out, R"({"id":42,"name":"a\tb你","ids":[1,2,3],"endpoints":[{"host":"h1","port":80},{"host":"","port":81}],)"
+                R"("primary":{"host":"p","port":0},"blob":(3)$a$b$,"enabled":1})");
+  BindConfig again;
+  JSONBind::read(out, again);
+  CHECK_EQ(JSONBind::write(again), out);
+  // the bound text is still plain json for the tree parser
+  CHECK_EQ(JSON(out)["endpoints"][1]["port"].get_int(), 81);
+
+  bool thrown = false;
+  try
+  {
+    JSONBind::read(R"({"id": "x"})", again);
+  }
+  catch (std::runtime_error &e)
+  {
+    thrown = true;
+    CHECK_EQ(std::string(e.what()), "JSONBind: expected an integer at offset 7");
+  }
+  CHECK_EQ(thrown, true);
+
+  // negative values would not come back through JSON(str), so neither side takes them
+  BindConfig neg;
+  neg.id = 5;
+  CHECK_EQ(JSON(JSONBind::write(neg))["id"].get_int(), 5);
+  neg.id = -5;
+  thrown = false;
+  try
+  {
+    JSONBind::write(neg);
+  }
+  catch (std::runtime_error &)
+  {
+    thrown = true;
+  }
+  CHECK_EQ(thrown, true);
+  thrown = false;
+  try
+  {
+    JSONBind::read(R"({"id": -5})", neg);
+  }
+  catch (std::runtime_error &e)
+  {
+    thrown = true;
+    CHECK_EQ(std::string(e.what()), "JSONBind: negative integers are not supported at offset 7");
+  }
+  CHECK_EQ(thrown, true);
+  JSON tree;
+  CHECK_EQ(JSON::try_parse(R"({"id": -5})", tree), JSON::ERR_UNEXPECTED_CHAR);
+
+  // narrow members take what fits and throw on the rest
+  BindNarrow narrow;
+  JSONBind::read(R"({"small": 255, "port": 2147483647})", narrow);
+  CHECK_EQ(int(narrow.small), 255);
+  CHECK_EQ(narrow.port, 2147483647);
+  const char *too_big[] = {R"({"small": 300})", R"({"port": 4294967297})"};
+  for (auto text : too_big)
+  {
+    thrown = false;
+    try
+    {
+      JSONBind::read(text, narrow);
+    }
+    catch (std::runtime_error &e)
+    {
+      thrown = true;
+      CHECK_EQ(std::string(e.what()).find("integer out of range"), 10);
+    }
+    CHECK_EQ(thrown, true);
+  }
+  CHECK_EQ(int(narrow.small), 255);
+}
+
+#ifdef JSON_LITE_STATS
+void test_stats()
+{
+  std::cout << "Running test: stats test: test_stats\n";
+  int parses = 0;
+  JSON::set_stats_hook([&](const char *event, const JSON::Stats &) {
+    if (std::string(event) == "parse")
+      parses++;
+  });
+  std::string text = R"({"a": [1, 2, {"b": "x\ty"}], "c": "plain"})";
+  JSON json(text);
+  const JSON::Stats &st = JSON::last_stats();
+  CHECK_EQ(parses, 1);
+  CHECK_EQ(st.bytes, text.size());
+  CHECK_EQ(st.nodes[JSON::INT], 2);
+  CHECK_EQ(st.nodes[JSON::STRING], 2);
+  CHECK_EQ(st.nodes[JSON::GROUP], 2);
+  CHECK_EQ(st.tokens[JSON::ARRAY], 1);
+  CHECK_EQ(st.escaped_strings, 1);
+  CHECK_EQ(st.plain_strings, 4);
+  CHECK_EQ(st.max_depth, 3);
+  std::string out = json.to_string();
+  CHECK_EQ(JSON::last_stats().bytes, out.size());
+  JSON::set_stats_hook(nullptr);
+}
+#endif
+
 int main()
 {
   test_unicode();
   test_escape();
+  test_try_parse();
+  test_limits();
+  test_schema();
+  test_group();
+  test_packed_array();
+  test_projection();
+  test_pointer();
+  test_patch();
+  test_cached_output();
+  test_hash_diff();
+  test_snapshot();
+  test_context();
+  test_stream();
+  test_columns();
+  test_index();
+  test_base64();
+#ifdef JSON_LITE_PMR
+  test_resource();
+#endif
+  test_bind();
+#ifdef JSON_LITE_STATS
+  test_stats();
+#endif
 
   std::cout << "==============================================\n";
   std::cout << "total assert: " << tot_assert << "\n";